@@ -1,11 +1,15 @@
 #version 330
 
+// unpacked vertex (mesh_format triangles and quads)
 layout(location = 0) in vec3 relative_position_in;
 layout(location = 1) in float face_and_rotation_in;
 layout(location = 2) in float tex_index_in;
+// packed vertex (mesh_format packed): x, y, z (6 bits each), face (3 bits), rotation (2 bits), texture index (9 bits)
+layout(location = 3) in uint packed_vertex_in;
 
 uniform mat4 mvp_matrix;
 uniform vec3 position_offset;
+uniform bool packed_vertex;
 
 out vec3 relative_position;
 out vec3 position;
@@ -15,11 +19,25 @@ flat out int tex_index;
 
 void main()
 {
-	relative_position = relative_position_in;
-	position = relative_position_in + position_offset;
-	int face_and_rotation = int(face_and_rotation_in);
+	int face_and_rotation;
+	if(packed_vertex)
+	{
+		relative_position = vec3(
+			packed_vertex_in & 63u,
+			(packed_vertex_in >> 6) & 63u,
+			(packed_vertex_in >> 12) & 63u
+		);
+		face_and_rotation = int((packed_vertex_in >> 18) & 31u);
+		tex_index = int(packed_vertex_in >> 23);
+	}
+	else
+	{
+		relative_position = relative_position_in;
+		face_and_rotation = int(face_and_rotation_in);
+		tex_index = int(tex_index_in);
+	}
+	position = relative_position + position_offset;
 	face = face_and_rotation & 7;
 	rotation = face_and_rotation >> 3;
-	tex_index = int(tex_index_in);
 	gl_Position = mvp_matrix * vec4(position, 1);
 }
@@ -1,11 +1,14 @@
 #include "Gfx.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <limits>
 #include <stdexcept>
+#include <stdint.h>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -22,6 +25,7 @@
 #include "settings.hpp"
 #include "block/enums/type.hpp"
 #include "fwd/chunk/Chunk.hpp"
+#include "chunk/Mesher/Base.hpp"
 #include "event/EventManager.hpp"
 #include "event/EventType.hpp"
 #include "event/type/Event_change_setting.hpp"
@@ -81,6 +85,8 @@ Gfx::Gfx()
 	buf_rt(window_size),
 	quad_vbo({3, GL_BYTE}),
 	quad_vao(quad_vbo),
+	quad_index_buffer({1, GL_UNSIGNED_INT}),
+	quad_index_buffer_quads(0),
 	s_gui_shape("shaders/gui_shape"),
 	gui_rectangle_vbo({2, GL_FLOAT}),
 	gui_rectangle_vao(gui_rectangle_vbo)
@@ -271,6 +277,29 @@ void Gfx::opengl_setup()
 	quad_vbo.data(sizeof(quad_vertex_buffer_data), quad_vertex_buffer_data, graphics::opengl::vertex_buffer::usage_hint::static_draw);
 }
 
+void Gfx::reserve_quad_indices(const std::size_t quad_count)
+{
+	if(quad_count <= quad_index_buffer_quads)
+	{
+		return;
+	}
+	// grow geometrically so that a few bigger meshes do not each remake the buffer
+	const std::size_t new_quads = std::max(quad_count, quad_index_buffer_quads * 2);
+
+	std::vector<GLuint> indices;
+	indices.reserve(new_quads * mesher::quad_indices.size());
+	for(std::size_t q = 0; q < new_quads; ++q)
+	{
+		for(const uint8_t i : mesher::quad_indices)
+		{
+			indices.push_back(static_cast<GLuint>(q * 4 + i));
+		}
+	}
+	// vertex arrays refer to the buffer by name, so they see the new data
+	quad_index_buffer.data(indices.size() * sizeof(GLuint), indices.data(), graphics::opengl::vertex_buffer::usage_hint::static_draw);
+	quad_index_buffer_quads = new_quads;
+}
+
 void Gfx::update_framebuffer_size(const window_size_t& window_size)
 {
 	this->window_size = window_size;
@@ -594,6 +623,11 @@ static void shim_GL_ARB_direct_state_access()
 		glBindVertexArray(vaobj);
 		glDisableVertexAttribArray(index);
 	};
+	glVertexArrayElementBuffer = [](GLuint vaobj, GLuint buffer) -> void
+	{
+		glBindVertexArray(vaobj);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	};
 
 	glCreateTextures = [](GLenum target, GLsizei n, GLuint* ids) -> void
 	{
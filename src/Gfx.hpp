@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
 #include <map>
 #include <string>
 
@@ -80,6 +81,11 @@ public:
 	graphics::opengl::vertex_array quad_vao;
 	void set_screen_shader(const std::string&);
 
+	// indexes for drawing quad meshes (see mesher::quad_indices), shared by every chunk
+	graphics::opengl::vertex_buffer quad_index_buffer;
+	std::size_t quad_index_buffer_quads;
+	void reserve_quad_indices(std::size_t quad_count);
+
 	/**
 	 * Set borderless window (true) or normal window (false)
 	 *
@@ -12,6 +12,7 @@
 #include "event/EventManager.hpp"
 #include "event/type/Event_enter_block.hpp"
 #include "position/block_in_world.hpp"
+#include "util/epoch.hpp"
 #include "world/world.hpp"
 
 using std::string;
@@ -28,7 +29,8 @@ Player::Player
 :
 	name(name),
 	reach_distance(16),
-	spawn_position(0.5, 1.0, 0.5), // TODO: generate this
+	// on top of the ground at the middle of the world
+	spawn_position(0.5, static_cast<double>(g.world.get_surface_height(0, 0) + 1), 0.5),
 	position(spawn_position, [this, &g](glm::dvec3 p)
 	{
 		p.y += eye_height;
@@ -83,6 +85,8 @@ void Player::move(const glm::dvec3& acceleration)
 		return;
 	}
 
+	// one guard for the collision checks, so that each get_block does not synchronize
+	const util::epoch::guard read_guard;
 	const position::block_in_world block_pos_old(position);
 	auto loop = [this, &new_position, &block_pos_old](const bool corners)
 	{
@@ -99,12 +99,22 @@ void base::light(const graphics::color& light)
 
 fs::path base::shader(const enums::Face face) const
 {
-	return shader_[static_cast<std::size_t>(rotation_util::rotate_face(face, rotation()))];
+	return shader(face, rotation());
 }
 
 fs::path base::texture(const enums::Face face) const
 {
-	return texture_[static_cast<std::size_t>(rotation_util::rotate_face(face, rotation()))];
+	return texture(face, rotation());
+}
+
+const fs::path& base::shader(const enums::Face face, const glm::tvec3<uint8_t>& rotation) const
+{
+	return shader_[static_cast<std::size_t>(rotation_util::rotate_face(face, rotation))];
+}
+
+const fs::path& base::texture(const enums::Face face, const glm::tvec3<uint8_t>& rotation) const
+{
+	return texture_[static_cast<std::size_t>(rotation_util::rotate_face(face, rotation))];
 }
 
 glm::tvec3<uint8_t> base::rotation() const
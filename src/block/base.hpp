@@ -51,6 +51,12 @@ public:
 	fs::path shader(enums::Face) const;
 	fs::path texture(enums::Face) const;
 
+	/**
+	 * The shader or texture of a face if this block had the given rotation
+	 */
+	const fs::path& shader(enums::Face, const glm::tvec3<uint8_t>& rotation) const;
+	const fs::path& texture(enums::Face, const glm::tvec3<uint8_t>& rotation) const;
+
 	glm::tvec3<uint8_t> rotation() const;
 	virtual uint8_t rotation(enums::Face) const;
 	virtual void rotate_around(enums::Face, int8_t direction);
@@ -1,10 +1,18 @@
 #include "Chunk.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
 #include <cstddef>
+#include <cstdlib>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <random>
 #include <stdexcept>
 #include <stdint.h>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -13,9 +21,11 @@
 
 #include "camera.hpp"
 #include "game.hpp"
+#include "Gfx.hpp"
 #include "settings.hpp"
-#include "fwd/block/base.hpp"
+#include "block/base.hpp"
 #include "chunk/Mesher/Base.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
 #include "event/EventManager.hpp"
 #include "event/EventType.hpp"
 #include "event/type/Event_change_setting.hpp"
@@ -41,6 +51,116 @@ using position::chunk_in_world;
 
 constexpr uint32_t CHUNK_SIZE_2 = CHUNK_SIZE + 2;
 
+// a bit per section
+using section_mask_t = uint8_t;
+static_assert(CHUNK_SECTION_COUNT <= 8, "a bit for each section must fit in section_mask_t");
+constexpr section_mask_t all_sections = static_cast<section_mask_t>((1u << CHUNK_SECTION_COUNT) - 1);
+
+static std::size_t section_index(const block_in_chunk& pos)
+{
+	constexpr int_fast32_t N = CHUNK_SECTIONS_PER_AXIS;
+	return static_cast<std::size_t>
+	(
+		  (pos.x / CHUNK_SECTION_SIZE) * N * N
+		+ (pos.y / CHUNK_SECTION_SIZE) * N
+		+ (pos.z / CHUNK_SECTION_SIZE)
+	);
+}
+
+/**
+ * How meshes are given to OpenGL, from the setting mesh_format.
+ * triangles is the old layout, kept for shaders that have not been updated for the others.
+ */
+enum class mesh_format
+{
+	triangles, // 6 vertexes (6 bytes each) per face
+	quads,     // 4 vertexes (6 bytes each) per face, drawn with the shared quad indexes
+	packed,    // 4 vertexes (mesher::mesh_packed_vertex_t) per face, drawn with the shared quad indexes
+};
+
+// only called from the main thread
+static mesh_format get_mesh_format()
+{
+	static std::string name;
+	static mesh_format format = mesh_format::quads;
+
+	std::string new_name = settings::get<std::string>("mesh_format");
+	if(new_name != name)
+	{
+		name = std::move(new_name);
+		if(name == "triangles")
+		{
+			format = mesh_format::triangles;
+		}
+		else if(name == "quads")
+		{
+			format = mesh_format::quads;
+		}
+		else if(name == "packed")
+		{
+			format = mesh_format::packed;
+		}
+		else
+		{
+			LOG(ERROR) << "No such mesh format: " << name << '\n';
+			format = mesh_format::quads;
+		}
+	}
+	return format;
+}
+
+// only compared for equality, so a counter is enough
+// it starts at a random number, so that stamps from different runs are different
+static uint64_t new_light_stamp()
+{
+	static std::atomic<uint64_t> next = []()
+	{
+		std::random_device random;
+		return (uint64_t(random()) << 32) | random();
+	}();
+	uint64_t stamp;
+	do
+	{
+		stamp = next++;
+	}
+	while(stamp == 0); // 0 is saved for a missing neighbor
+	return stamp;
+}
+
+// the highest opaque block of each column, for chunks that are loaded instead of made a block at a time
+static chunk_heightmap_t make_heightmap(const chunk_blocks_t::snapshot& blocks)
+{
+	std::vector<bool> opaque;
+	opaque.reserve(blocks.palette.size());
+	for(const shared_ptr<block::base>& block : blocks.palette)
+	{
+		opaque.emplace_back(block != nullptr && block->is_opaque());
+	}
+
+	chunk_heightmap_t heightmap;
+
+	if(blocks.indices.empty())
+	{
+		heightmap.fill(opaque[0] ? static_cast<int8_t>(CHUNK_SIZE - 1) : -1);
+		return heightmap;
+	}
+	for(int_fast32_t x = 0; x < CHUNK_SIZE; ++x)
+	for(int_fast32_t z = 0; z < CHUNK_SIZE; ++z)
+	{
+		int8_t top = -1;
+		for(int_fast32_t y = CHUNK_SIZE - 1; y >= 0; --y)
+		{
+			if(opaque[blocks.indices[static_cast<std::size_t>(CHUNK_SIZE * CHUNK_SIZE * x + CHUNK_SIZE * y + z)]])
+			{
+				top = static_cast<int8_t>(y);
+				break;
+			}
+		}
+		heightmap[static_cast<std::size_t>(x * CHUNK_SIZE + z)] = top;
+	}
+	return heightmap;
+}
+
 struct Chunk::impl
 {
 	impl
@@ -52,9 +172,15 @@ struct Chunk::impl
 		owner(owner),
 		position(position),
 		light_changed(false),
-		changed(false)
+		drawn_tick(0),
+		stage(Chunk::stage::made),
+		light_stamp(new_light_stamp()),
+		dirty_sections(all_sections),
+		changed(false),
+		vao_format(mesh_format::quads)
 	{
-		light_tex_buf.fill(0);
+		// a new chunk is all air
+		heightmap.fill(-1);
 
 		light_smoothing_eid = game::instance->event_manager.add_handler(EventType::change_setting, [this](const Event& event)
 		{
@@ -87,45 +213,74 @@ struct Chunk::impl
 		}
 	}
 
-	void init_light_tex()
-	{
-		light_tex = std::make_unique<graphics::opengl::texture>(GL_TEXTURE_3D);
-		set_light_tex_data();
-		light_tex->parameter(graphics::opengl::texture::Parameter::wrap_s, GL_CLAMP_TO_EDGE);
-		light_tex->parameter(graphics::opengl::texture::Parameter::wrap_t, GL_CLAMP_TO_EDGE);
-		light_tex->parameter(graphics::opengl::texture::Parameter::min_filter, GL_NEAREST);
-		const GLint mag_filter = static_cast<GLint>((settings::get<int64_t>("light_smoothing") == 0) ? GL_NEAREST : GL_LINEAR);
-		light_tex->parameter(graphics::opengl::texture::Parameter::mag_filter, mag_filter);
-		light_changed = false;
-	}
+	void init_light_tex(const chunk_light_t::snapshot&, const chunk_skylight_t::snapshot&);
+	void make_light_tex_buf(const chunk_light_t::snapshot&, const chunk_skylight_t::snapshot&);
 
 	void set_light_tex_data()
 	{
-		light_tex->image3D(0, GL_RGB, CHUNK_SIZE_2, CHUNK_SIZE_2, CHUNK_SIZE_2, GL_RGB, GL_UNSIGNED_BYTE, light_tex_buf.data());
+		assert(light_tex_buf != nullptr);
+		light_tex->image3D(0, GL_RGB, CHUNK_SIZE_2, CHUNK_SIZE_2, CHUNK_SIZE_2, GL_RGB, GL_UNSIGNED_BYTE, light_tex_buf->data());
 	}
 
-	graphics::color get_blocklight(const block_in_chunk&) const;
-	void set_blocklight(const block_in_chunk&, const graphics::color& color);
 	void set_texbuflight(const glm::ivec3& pos, const graphics::color& color);
 
+	static std::size_t neighbor_index(const glm::ivec3& offset)
+	{
+		assert(offset != glm::ivec3(0));
+		assert(std::abs(offset.x) <= 1 && std::abs(offset.y) <= 1 && std::abs(offset.z) <= 1);
+		return static_cast<std::size_t>((offset.x + 1) * 9 + (offset.y + 1) * 3 + (offset.z + 1));
+	}
+	shared_ptr<Chunk> get_neighbor(const glm::ivec3& offset) const
+	{
+		std::lock_guard<std::mutex> g(neighbors_mutex);
+		return neighbors[neighbor_index(offset)].lock();
+	}
+
+	void free_light_tex()
+	{
+		light_tex = nullptr;
+		light_tex_buf = nullptr;
+		light_changed = false;
+	}
+
 	world::world& owner;
 	chunk_in_world position;
 
+	chunk_heightmap_t heightmap;
+
 	unique_ptr<graphics::opengl::texture> light_tex;
 	bool light_changed;
+	uint64_t drawn_tick; // when the light texture was last used
 	event_handler_id_t light_smoothing_eid;
 
+	std::atomic<Chunk::stage> stage;
+
+	std::atomic<uint64_t> light_stamp;
+	std::optional<std::array<uint64_t, 6>> saved_neighbor_stamps;
+	std::optional<chunk_sky_floor_t> saved_sky_floor;
+
+	// weak, so that a chunk taken out of the world is not kept alive by its neighbors
+	std::array<std::weak_ptr<Chunk>, 27> neighbors;
+	mutable std::mutex neighbors_mutex;
+
+	std::atomic<section_mask_t> dirty_sections;
+	// the meshes of each section, used only by update
+	std::array<mesher::meshmap_t, CHUNK_SECTION_COUNT> section_meshes;
+	std::mutex update_mutex;
+
 	bool changed;
 	mesher::meshmap_t meshes;
 	std::vector<graphics::opengl::vertex_array> mesh_vaos;
 	std::vector<graphics::opengl::vertex_buffer> mesh_vbos;
+	mesh_format vao_format;
 	mutable std::mutex mesh_mutex;
 
 	void update_vaos();
 
 private:
-	ChunkData<graphics::color> blocklight;
-	std::array<uint8_t, CHUNK_SIZE_2 * CHUNK_SIZE_2 * CHUNK_SIZE_2 * 3> light_tex_buf;
+	// made when the chunk is drawn and freed when it has not been drawn for a while, since most chunks (such as ones in the sky or out of render range) are not drawn
+	using light_tex_buf_t = std::array<uint8_t, CHUNK_SIZE_2 * CHUNK_SIZE_2 * CHUNK_SIZE_2 * 3>;
+	unique_ptr<light_tex_buf_t> light_tex_buf;
 };
 
 Chunk::Chunk(const chunk_in_world& position, world::world& owner)
@@ -138,6 +293,17 @@ Chunk::~Chunk()
 {
 }
 
+Chunk::stage Chunk::get_stage() const
+{
+	return pImpl->stage;
+}
+
+bool Chunk::advance_stage(const stage from, const stage to)
+{
+	stage expected = from;
+	return pImpl->stage.compare_exchange_strong(expected, to);
+}
+
 world::world& Chunk::get_owner() const
 {
 	return pImpl->owner;
@@ -158,6 +324,50 @@ shared_ptr<block::base> Chunk::get_block(const block_in_chunk& pos)
 	return blocks.get(pos);
 }
 
+shared_ptr<Chunk> Chunk::get_neighbor(const glm::ivec3& offset) const
+{
+	return pImpl->get_neighbor(offset);
+}
+
+Chunk::near_position Chunk::resolve_near(const glm::ivec3& pos)
+{
+	near_position near;
+	for(uint_fast8_t i = 0; i < 3; ++i)
+	{
+		assert(pos[i] >= -CHUNK_SIZE && pos[i] < 2 * CHUNK_SIZE);
+		near.offset[i] = (pos[i] < 0) ? -1 : (pos[i] >= CHUNK_SIZE) ? 1 : 0;
+		near.pos[i] = static_cast<block_in_chunk::value_type>(pos[i] - near.offset[i] * CHUNK_SIZE);
+	}
+	return near;
+}
+
+shared_ptr<block::base> Chunk::get_block_near(const glm::ivec3& pos) const
+{
+	const near_position near = resolve_near(pos);
+	if(near.offset == glm::ivec3(0))
+	{
+		return get_block(near.pos);
+	}
+	const shared_ptr<Chunk> chunk = get_neighbor(near.offset);
+	if(chunk == nullptr)
+	{
+		return nullptr;
+	}
+	return chunk->get_block(near.pos);
+}
+
+void Chunk::set_neighbor(const glm::ivec3& offset, const shared_ptr<Chunk>& chunk)
+{
+	std::lock_guard<std::mutex> g(pImpl->neighbors_mutex);
+	pImpl->neighbors[impl::neighbor_index(offset)] = chunk;
+}
+
+void Chunk::clear_neighbors()
+{
+	std::lock_guard<std::mutex> g(pImpl->neighbors_mutex);
+	pImpl->neighbors.fill({});
+}
+
 void Chunk::set_block(const block_in_chunk& pos, shared_ptr<block::base> block)
 {
 	if(block == nullptr)
@@ -165,33 +375,130 @@ void Chunk::set_block(const block_in_chunk& pos, shared_ptr<block::base> block)
 		throw std::invalid_argument("Chunk::set_block: got a null block");
 	}
 	blocks.set(pos, block);
+
+	int8_t& top = pImpl->heightmap[static_cast<std::size_t>(pos.x * CHUNK_SIZE + pos.z)];
+	if(block->is_opaque())
+	{
+		top = std::max(top, static_cast<int8_t>(pos.y));
+	}
+	else if(pos.y == top)
+	{
+		// find the next opaque block down
+		top = -1;
+		const chunk_blocks_t::reader reader = blocks.read();
+		block_in_chunk below = pos;
+		while(below.y > 0)
+		{
+			--below.y;
+			if(reader.get(below)->is_opaque())
+			{
+				top = static_cast<int8_t>(below.y);
+				break;
+			}
+		}
+	}
 }
 
-graphics::color Chunk::get_blocklight(const block_in_chunk& pos) const
+shared_ptr<block::base> Chunk::get_uniform_block() const
+{
+	return blocks.get_uniform().value_or(nullptr);
+}
+
+bool Chunk::is_invisible() const
+{
+	const shared_ptr<block::base> block = get_uniform_block();
+	return block != nullptr && block->is_invisible();
+}
+
+chunk_blocks_t::snapshot Chunk::copy_blocks() const
+{
+	return blocks.copy_out();
+}
+
+chunk_blocks_t::snapshot Chunk::copy_blocks(const block_in_chunk& min, const block_in_chunk& max) const
+{
+	return blocks.copy_out(min, max);
+}
+
+const chunk_heightmap_t& Chunk::get_heightmap() const
 {
-	return pImpl->get_blocklight(pos);
+	return pImpl->heightmap;
 }
-graphics::color Chunk::impl::get_blocklight(const block_in_chunk& pos) const
+
+graphics::color Chunk::get_blocklight(const block_in_chunk& pos) const
 {
 	return blocklight.get(pos);
 }
 
-void Chunk::set_blocklight
-(
-	const block_in_chunk& pos,
-	const graphics::color& color
-)
+chunk_light_t::snapshot Chunk::copy_blocklight() const
+{
+	return blocklight.copy_out();
+}
+
+chunk_light_t::snapshot Chunk::copy_blocklight(const block_in_chunk& min, const block_in_chunk& max) const
+{
+	return blocklight.copy_out(min, max);
+}
+
+graphics::color::value_type Chunk::get_skylight(const block_in_chunk& pos) const
+{
+	return skylight.get(pos);
+}
+
+chunk_skylight_t::snapshot Chunk::copy_skylight() const
+{
+	return skylight.copy_out();
+}
+
+chunk_skylight_t::snapshot Chunk::copy_skylight(const block_in_chunk& min, const block_in_chunk& max) const
+{
+	return skylight.copy_out(min, max);
+}
+
+graphics::color Chunk::mix_light(const graphics::color& blocklight, const graphics::color::value_type skylight)
 {
-	pImpl->set_blocklight(pos, color);
+	return
+	{
+		std::max(blocklight.r, skylight),
+		std::max(blocklight.g, skylight),
+		std::max(blocklight.b, skylight),
+	};
 }
-void Chunk::impl::set_blocklight
+
+void Chunk::set_light
 (
-	const block_in_chunk& pos,
-	const graphics::color& color
+	const std::vector<std::pair<std::size_t, graphics::color>>& blocklight_changes,
+	const std::vector<std::pair<std::size_t, graphics::color::value_type>>& skylight_changes
 )
 {
-	blocklight.set(pos, color);
-	set_texbuflight({pos.x, pos.y, pos.z}, color);
+	if(blocklight_changes.empty() && skylight_changes.empty())
+	{
+		return;
+	}
+	blocklight.set(blocklight_changes);
+	skylight.set(skylight_changes);
+	pImpl->light_stamp = new_light_stamp();
+}
+
+void Chunk::fill_skylight(const graphics::color::value_type light)
+{
+	skylight.fill(light);
+	pImpl->light_stamp = new_light_stamp();
+}
+
+uint64_t Chunk::get_light_stamp() const
+{
+	return pImpl->light_stamp;
+}
+
+std::optional<std::array<uint64_t, 6>> Chunk::get_saved_neighbor_stamps() const
+{
+	return pImpl->saved_neighbor_stamps;
+}
+
+std::optional<chunk_sky_floor_t> Chunk::get_saved_sky_floor() const
+{
+	return pImpl->saved_sky_floor;
 }
 
 void Chunk::set_texbuflight(const glm::ivec3& pos, const graphics::color& color)
@@ -205,15 +512,145 @@ void Chunk::impl::set_texbuflight(const glm::ivec3& pos, const graphics::color&
 			+ static_cast<std::size_t>(pos.y + 1) * CHUNK_SIZE_2
 			+ static_cast<std::size_t>(pos.x + 1)
 		);
-	light_tex_buf[i    ] = color.r;
-	light_tex_buf[i + 1] = color.g;
-	light_tex_buf[i + 2] = color.b;
+	if(light_tex_buf == nullptr)
+	{
+		// it gets this light when it is made
+		return;
+	}
+	(*light_tex_buf)[i    ] = color.r;
+	(*light_tex_buf)[i + 1] = color.g;
+	(*light_tex_buf)[i + 2] = color.b;
 	light_changed = true;
 }
 
+void Chunk::impl::init_light_tex(const chunk_light_t::snapshot& blocklight, const chunk_skylight_t::snapshot& skylight)
+{
+	make_light_tex_buf(blocklight, skylight);
+	light_tex = std::make_unique<graphics::opengl::texture>(GL_TEXTURE_3D);
+	set_light_tex_data();
+	light_tex->parameter(graphics::opengl::texture::Parameter::wrap_s, GL_CLAMP_TO_EDGE);
+	light_tex->parameter(graphics::opengl::texture::Parameter::wrap_t, GL_CLAMP_TO_EDGE);
+	light_tex->parameter(graphics::opengl::texture::Parameter::min_filter, GL_NEAREST);
+	const GLint mag_filter = static_cast<GLint>((settings::get<int64_t>("light_smoothing") == 0) ? GL_NEAREST : GL_LINEAR);
+	light_tex->parameter(graphics::opengl::texture::Parameter::mag_filter, mag_filter);
+	light_changed = false;
+}
+
+void Chunk::impl::make_light_tex_buf(const chunk_light_t::snapshot& blocklight, const chunk_skylight_t::snapshot& skylight)
+{
+	light_tex_buf = std::make_unique<light_tex_buf_t>();
+	light_tex_buf->fill(0);
+
+	block_in_chunk pos;
+	for(pos.x = 0; pos.x < CHUNK_SIZE; ++pos.x)
+	for(pos.y = 0; pos.y < CHUNK_SIZE; ++pos.y)
+	for(pos.z = 0; pos.z < CHUNK_SIZE; ++pos.z)
+	{
+		set_texbuflight(glm::ivec3(pos.x, pos.y, pos.z), Chunk::mix_light(blocklight.get(pos), skylight.get(pos)));
+	}
+
+	// the border has the light of the neighbors, and stays dark where there is none
+	// the side of each neighbor that touches this chunk is copied at once, instead of reading it a block at a time
+	glm::ivec3 d;
+	for(d.x = -1; d.x <= 1; ++d.x)
+	for(d.y = -1; d.y <= 1; ++d.y)
+	for(d.z = -1; d.z <= 1; ++d.z)
+	{
+		if(d == glm::ivec3(0))
+		{
+			continue;
+		}
+		const shared_ptr<Chunk> chunk2 = get_neighbor(d);
+		if(chunk2 == nullptr)
+		{
+			continue;
+		}
+		block_in_chunk min;
+		block_in_chunk max;
+		for(uint_fast8_t i = 0; i < 3; ++i)
+		{
+			min[i] = static_cast<block_in_chunk::value_type>((d[i] == -1) ? CHUNK_SIZE - 1 : 0);
+			max[i] = static_cast<block_in_chunk::value_type>((d[i] == 1) ? 0 : CHUNK_SIZE - 1);
+		}
+		const chunk_light_t::snapshot blocklight2 = chunk2->copy_blocklight(min, max);
+		const chunk_skylight_t::snapshot skylight2 = chunk2->copy_skylight(min, max);
+		std::size_t i = 0;
+		glm::ivec3 pos2;
+		for(pos2.x = min.x; pos2.x <= max.x; ++pos2.x)
+		for(pos2.y = min.y; pos2.y <= max.y; ++pos2.y)
+		for(pos2.z = min.z; pos2.z <= max.z; ++pos2.z, ++i)
+		{
+			// from the neighbor's coordinates to this chunk's
+			set_texbuflight(pos2 + d * CHUNK_SIZE, Chunk::mix_light(blocklight2[i], skylight2[i]));
+		}
+	}
+}
+
+void Chunk::mark_dirty(const block_in_chunk& pos)
+{
+	pImpl->dirty_sections |= static_cast<section_mask_t>(1u << section_index(pos));
+}
+
+void Chunk::mark_all_dirty()
+{
+	pImpl->dirty_sections = all_sections;
+}
+
+bool Chunk::has_dirty_sections() const
+{
+	return pImpl->dirty_sections != 0;
+}
+
 void Chunk::update()
 {
-	mesher::meshmap_t meshes = pImpl->owner.mesher->make_mesh(*this);
+	// updates of the same chunk take turns, so an older update can not overwrite a newer section
+	std::lock_guard<std::mutex> ug(pImpl->update_mutex);
+
+	// sections marked after this are remade by the next update
+	const section_mask_t dirty = pImpl->dirty_sections.exchange(0);
+	if(dirty == 0)
+	{
+		return;
+	}
+
+	if(is_invisible())
+	{
+		for(mesher::meshmap_t& section_mesh : pImpl->section_meshes)
+		{
+			section_mesh = {};
+		}
+	}
+	else
+	{
+		mesher::padded_chunk blocks(*this);
+		for(int_fast16_t s = 0; s < CHUNK_SECTION_COUNT; ++s)
+		{
+			if((dirty & (1u << s)) == 0)
+			{
+				continue;
+			}
+			constexpr int_fast32_t N = CHUNK_SECTIONS_PER_AXIS;
+			const glm::tvec3<int_fast16_t> min
+			(
+				(s / (N * N)) * CHUNK_SECTION_SIZE,
+				(s / N % N) * CHUNK_SECTION_SIZE,
+				(s % N) * CHUNK_SECTION_SIZE
+			);
+			blocks.set_mesh_bounds(min, min + static_cast<int_fast16_t>(CHUNK_SECTION_SIZE));
+			pImpl->section_meshes[static_cast<std::size_t>(s)] = pImpl->owner.mesher->make_mesh(blocks);
+		}
+	}
+
+	// the sections are drawn together
+	mesher::meshmap_t meshes;
+	for(const mesher::meshmap_t& section_mesh : pImpl->section_meshes)
+	{
+		for(const auto& p : section_mesh)
+		{
+			mesher::mesh_t& mesh = meshes[p.first];
+			mesh.insert(mesh.end(), p.second.cbegin(), p.second.cend());
+		}
+	}
 
 	std::lock_guard<std::mutex> g(pImpl->mesh_mutex);
 	pImpl->meshes = std::move(meshes);
@@ -226,11 +663,6 @@ void Chunk::render(const bool translucent_pass)
 
 	if(pImpl->changed)
 	{
-		if(pImpl->light_tex == nullptr)
-		{
-			pImpl->init_light_tex();
-		}
-
 		pImpl->update_vaos();
 
 		pImpl->changed = false;
@@ -241,10 +673,16 @@ void Chunk::render(const bool translucent_pass)
 		return;
 	}
 
-	if(pImpl->light_changed && pImpl->light_tex != nullptr)
+	if(pImpl->light_tex == nullptr)
+	{
+		pImpl->init_light_tex(copy_blocklight(), copy_skylight());
+	}
+	else if(pImpl->light_changed)
 	{
 		pImpl->set_light_tex_data();
+		pImpl->light_changed = false;
 	}
+	pImpl->drawn_tick = pImpl->owner.get_ticks();
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(pImpl->light_tex->type, pImpl->light_tex->get_name());
@@ -261,20 +699,49 @@ void Chunk::render(const bool translucent_pass)
 			continue;
 		}
 
-		resource<graphics::opengl::shader_program> shader = game::instance->resource_manager.get_shader_program(p.first.shader_path);
+		resource<graphics::opengl::shader_program> shader = game::instance->resource_manager.get_material_program(p.first.material);
 		shader->uniform("position_offset", position_offset);
 		shader->uniform("tex", p.first.tex_unit);
+		shader->uniform("packed_vertex", static_cast<GLint>(pImpl->vao_format == mesh_format::packed));
 
 		shader->use();
-		pImpl->mesh_vaos[i].draw(GL_TRIANGLES, 0, p.second.size() * 3);
+		const std::size_t vertex_count = p.second.size() * mesher::quad_indices.size();
+		if(pImpl->vao_format == mesh_format::triangles)
+		{
+			pImpl->mesh_vaos[i].draw(GL_TRIANGLES, 0, vertex_count);
+		}
+		else
+		{
+			pImpl->mesh_vaos[i].draw_elements(GL_TRIANGLES, vertex_count);
+		}
 
 		++i;
 	}
 }
 
+void Chunk::free_light_tex(const uint64_t tick)
+{
+	std::lock_guard<std::mutex> g(pImpl->mesh_mutex);
+	if(pImpl->light_tex != nullptr && pImpl->drawn_tick < tick)
+	{
+		pImpl->free_light_tex();
+	}
+}
+
+void Chunk::free_graphics()
+{
+	std::lock_guard<std::mutex> g(pImpl->mesh_mutex);
+	pImpl->free_light_tex();
+	pImpl->meshes.clear();
+	pImpl->mesh_vaos.clear();
+	pImpl->mesh_vbos.clear();
+	pImpl->changed = false;
+}
+
 void Chunk::set_blocks(chunk_blocks_t new_blocks)
 {
 	blocks = std::move(new_blocks);
+	pImpl->heightmap = make_heightmap(blocks.copy_out());
 }
 void Chunk::set_blocks(shared_ptr<block::base> block)
 {
@@ -283,15 +750,66 @@ void Chunk::set_blocks(shared_ptr<block::base> block)
 		throw std::invalid_argument("Chunk::set_blocks(single): got a null block");
 	}
 	blocks.fill(block);
+	pImpl->heightmap.fill(block->is_opaque() ? static_cast<int8_t>(CHUNK_SIZE - 1) : -1);
+}
+
+void Chunk::set_light
+(
+	chunk_light_t new_blocklight,
+	chunk_skylight_t new_skylight,
+	const uint64_t light_stamp,
+	const std::array<uint64_t, 6>& neighbor_light_stamps,
+	const chunk_sky_floor_t& sky_floor
+)
+{
+	blocklight = std::move(new_blocklight);
+	skylight = std::move(new_skylight);
+	pImpl->light_stamp = light_stamp;
+	pImpl->saved_neighbor_stamps = neighbor_light_stamps;
+	pImpl->saved_sky_floor = sky_floor;
 }
 
 void Chunk::impl::update_vaos()
 {
+	mesh_format format = get_mesh_format();
+	if(format == mesh_format::packed && !std::all_of(meshes.begin(), meshes.end(), [](const auto& p) { return mesher::can_pack(p.second); }))
+	{
+		// only said once, since every chunk with such a texture would say it
+		static bool warned = false;
+		if(!warned)
+		{
+			LOG(ERROR) << "There are too many textures for the packed mesh format; using quads for the chunks that have the later ones\n";
+			warned = true;
+		}
+		format = mesh_format::quads;
+	}
+	if(format != vao_format)
+	{
+		// the vertex layout is different, so remake everything
+		mesh_vaos.clear();
+		mesh_vbos.clear();
+		vao_format = format;
+	}
+
 	if(mesh_vaos.size() < meshes.size())
 	{
 		const std::size_t to_add = meshes.size() - mesh_vaos.size();
 		for(std::size_t i = 0; i < to_add; ++i)
 		{
+			if(vao_format == mesh_format::packed)
+			{
+				graphics::opengl::vertex_buffer::Format packed_format{1, GL_UNSIGNED_INT};
+				packed_format.integer = true;
+				graphics::opengl::vertex_buffer vbo(packed_format);
+				// the unpacked attributes are 0 to 2
+				graphics::opengl::vertex_array vao(vbo, 3);
+				vao.element_buffer(game::instance->gfx.quad_index_buffer);
+
+				mesh_vbos.emplace_back(std::move(vbo));
+				mesh_vaos.emplace_back(std::move(vao));
+				continue;
+			}
+
 			graphics::opengl::vertex_buffer vbo
 			({
 				{3, GL_UNSIGNED_BYTE}, // relative position
@@ -299,6 +817,10 @@ void Chunk::impl::update_vaos()
 				{1, GL_SHORT        }, // texture index
 			});
 			graphics::opengl::vertex_array vao(vbo);
+			if(vao_format == mesh_format::quads)
+			{
+				vao.element_buffer(game::instance->gfx.quad_index_buffer);
+			}
 
 			mesh_vbos.emplace_back(std::move(vbo));
 			mesh_vaos.emplace_back(std::move(vao));
@@ -311,7 +833,38 @@ void Chunk::impl::update_vaos()
 	{
 		const auto usage_hint = graphics::opengl::vertex_buffer::usage_hint::dynamic_draw;
 		const mesher::mesh_t& mesh = p.second;
-		mesh_vbos[i].data(mesh.size() * sizeof(mesher::mesh_t::value_type), mesh.data(), usage_hint);
+		if(vao_format == mesh_format::triangles)
+		{
+			std::vector<mesher::mesh_vertex_t> vertexes;
+			vertexes.reserve(mesh.size() * mesher::quad_indices.size());
+			for(const mesher::mesh_quad_t& quad : mesh)
+			{
+				for(const uint8_t v : mesher::quad_indices)
+				{
+					vertexes.push_back(quad[v]);
+				}
+			}
+			mesh_vbos[i].data(vertexes.size() * sizeof(mesher::mesh_vertex_t), vertexes.data(), usage_hint);
+		}
+		else if(vao_format == mesh_format::packed)
+		{
+			game::instance->gfx.reserve_quad_indices(mesh.size());
+			std::vector<mesher::mesh_packed_vertex_t> vertexes;
+			vertexes.reserve(mesh.size() * 4);
+			for(const mesher::mesh_quad_t& quad : mesh)
+			{
+				for(const mesher::mesh_vertex_t& v : quad)
+				{
+					vertexes.push_back(mesher::pack_vertex(v));
+				}
+			}
+			mesh_vbos[i].data(vertexes.size() * sizeof(mesher::mesh_packed_vertex_t), vertexes.data(), usage_hint);
+		}
+		else
+		{
+			game::instance->gfx.reserve_quad_indices(mesh.size());
+			mesh_vbos[i].data(mesh.size() * sizeof(mesher::mesh_quad_t), mesh.data(), usage_hint);
+		}
 		++i;
 	}
 }
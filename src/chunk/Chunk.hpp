@@ -1,10 +1,18 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <memory>
+#include <optional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <glm/vec3.hpp>
 
 #include "fwd/block/base.hpp"
 #include "chunk/ChunkData.hpp"
-#include "fwd/graphics/color.hpp"
+#include "graphics/color.hpp"
 #include "fwd/position/block_in_chunk.hpp"
 #include "fwd/position/chunk_in_world.hpp"
 #include "shim/propagate_const.hpp"
@@ -13,6 +21,18 @@
 namespace block_thingy {
 
 using chunk_blocks_t = ChunkData<std::shared_ptr<block::base>>;
+using chunk_light_t = ChunkData<graphics::color>;
+using chunk_skylight_t = ChunkData<graphics::color::value_type>;
+
+/**
+ * The y of the highest opaque block in each column of a chunk (by x * CHUNK_SIZE + z), or -1 if a column has none
+ */
+using chunk_heightmap_t = std::array<int8_t, CHUNK_SIZE * CHUNK_SIZE>;
+
+/**
+ * The lowest y that the sky reaches straight down in each column of a chunk (by x * CHUNK_SIZE + z), or CHUNK_SIZE if it does not reach the chunk
+ */
+using chunk_sky_floor_t = std::array<uint8_t, CHUNK_SIZE * CHUNK_SIZE>;
 
 class Chunk
 {
@@ -25,24 +45,170 @@ public:
 	Chunk& operator=(Chunk&&) = delete;
 	Chunk& operator=(const Chunk&) = delete;
 
+	/**
+	 * How far a chunk is through the world's pipeline. Each stage comes after the one before it.
+	 */
+	enum class stage : uint8_t
+	{
+		made,     // generated or loaded, but not in the world yet
+		lit,      // in the world, and light has spread into it
+		meshable, // every face neighbour is lit, so the mesher has every block it needs
+		meshed,
+	};
+	stage get_stage() const;
+
+	/**
+	 * Go to stage `to` if the chunk is at stage `from`
+	 *
+	 * @return `true` if the stage was changed
+	 */
+	bool advance_stage(stage from, stage to);
+
 	world::world& get_owner() const; // eeh
 	position::chunk_in_world get_position() const;
 
 	const std::shared_ptr<block::base> get_block(const position::block_in_chunk&) const;
 	std::shared_ptr<block::base> get_block(const position::block_in_chunk&);
 
+	/**
+	 * The chunk beside this one at an offset (each of x, y, and z from -1 to 1, not all 0), or `nullptr` if it is not in the world.
+	 * The world keeps these links, so this does not look anything up in the world.
+	 */
+	std::shared_ptr<Chunk> get_neighbor(const glm::ivec3& offset) const;
+
+	/**
+	 * Where a block given by coordinates relative to a chunk (from -CHUNK_SIZE to 2 * CHUNK_SIZE - 1) is:
+	 * the offset of the neighbor that has it (0 if it is in the chunk itself), and its position in that chunk
+	 */
+	struct near_position
+	{
+		glm::ivec3 offset;
+		position::block_in_chunk pos;
+	};
+	static near_position resolve_near(const glm::ivec3&);
+
+	/**
+	 * Get a block by coordinates relative to this chunk, from -CHUNK_SIZE to 2 * CHUNK_SIZE - 1, from a neighbor if it is outside this chunk.
+	 * Like get_neighbor, this does not look anything up in the world.
+	 *
+	 * @return `nullptr` if the block is in a neighbor that is not in the world
+	 */
+	std::shared_ptr<block::base> get_block_near(const glm::ivec3&) const;
+
 	void set_block(const position::block_in_chunk&, const std::shared_ptr<block::base>);
 
+	/**
+	 * @return The block at every position if this chunk contains only one block, or `nullptr` otherwise
+	 */
+	std::shared_ptr<block::base> get_uniform_block() const;
+
+	/**
+	 * @return `true` if every block in this chunk is invisible, meaning there is nothing to mesh or render
+	 */
+	bool is_invisible() const;
+
+	/**
+	 * @return A consistent copy of every block, for reading many blocks without per-block synchronization
+	 */
+	chunk_blocks_t::snapshot copy_blocks() const;
+
+	/**
+	 * @return A consistent copy of the blocks from `min` to `max` (both included), in the order of the box (see ChunkData::copy_out)
+	 */
+	chunk_blocks_t::snapshot copy_blocks(const position::block_in_chunk& min, const position::block_in_chunk& max) const;
+
+	/**
+	 * The highest opaque block of each column, kept up to date by `set_block` and `set_blocks`
+	 */
+	const chunk_heightmap_t& get_heightmap() const;
+
 	graphics::color get_blocklight(const position::block_in_chunk&) const;
-	void set_blocklight(const position::block_in_chunk&, const graphics::color&);
+	chunk_light_t::snapshot copy_blocklight() const;
+	chunk_light_t::snapshot copy_blocklight(const position::block_in_chunk& min, const position::block_in_chunk& max) const;
+	graphics::color::value_type get_skylight(const position::block_in_chunk&) const;
+	chunk_skylight_t::snapshot copy_skylight() const;
+	chunk_skylight_t::snapshot copy_skylight(const position::block_in_chunk& min, const position::block_in_chunk& max) const;
+
+	/**
+	 * The light that is drawn: for each color, the brightest of the block light and the (white) sky light
+	 */
+	static graphics::color mix_light(const graphics::color& blocklight, graphics::color::value_type skylight);
+
+	/**
+	 * Set the block light and sky light of many blocks at once, by index in the block order of ChunkData.
+	 * This does not change the light texture; that is done on the main thread with `set_texbuflight`.
+	 */
+	void set_light
+	(
+		const std::vector<std::pair<std::size_t, graphics::color>>& blocklight,
+		const std::vector<std::pair<std::size_t, graphics::color::value_type>>& skylight
+	);
+
+	/**
+	 * Set the sky light of every block, such as for a chunk that is all above the ground
+	 */
+	void fill_skylight(graphics::color::value_type);
+
+	/**
+	 * A number that changes whenever the light of this chunk changes, saved with the light.
+	 * A loaded chunk compares these with its neighbors to know whether its saved light still fits with theirs.
+	 */
+	uint64_t get_light_stamp() const;
+
+	/**
+	 * The light stamps of the face neighbors (in the order of block::enums::Face, with 0 for a missing neighbor) when this chunk was saved,
+	 * or `std::nullopt` if it was not loaded with its light
+	 */
+	std::optional<std::array<uint64_t, 6>> get_saved_neighbor_stamps() const;
+
+	/**
+	 * Where the sky reached when this chunk was saved, or `std::nullopt` if it was not loaded with its light
+	 */
+	std::optional<chunk_sky_floor_t> get_saved_sky_floor() const;
+
+	/**
+	 * Set a value of the light texture, which has a border (from -1 to CHUNK_SIZE) for the light of the neighbors.
+	 * The texture is made from the saved light when the chunk is drawn, so this does nothing while it has none.
+	 * Only call this from the main thread.
+	 */
 	void set_texbuflight(const glm::ivec3& pos, const graphics::color&);
 
+	/**
+	 * Mark the mesh section with this block to be remade by the next `update`
+	 */
+	void mark_dirty(const position::block_in_chunk&);
+	void mark_all_dirty();
+	bool has_dirty_sections() const;
+
+	/**
+	 * Remake the meshes of the sections that are marked dirty (every section of a new chunk is dirty)
+	 */
 	void update();
 	void render(bool transluscent_pass);
 
+	/**
+	 * Free the light texture if this was not drawn since the world tick `tick`, such as when it is out of render range.
+	 * It is made again when this is next drawn. Only call this from the main thread.
+	 */
+	void free_light_tex(uint64_t tick);
+
+	/**
+	 * Free the meshes and the light texture, when this is taken out of the world.
+	 * Only call this from the main thread; the last reference to a chunk can be dropped by another thread, which can not free them.
+	 */
+	void free_graphics();
+
 	// for loading
 	void set_blocks(chunk_blocks_t);
 	void set_blocks(std::shared_ptr<block::base>);
+	void set_light
+	(
+		chunk_light_t blocklight,
+		chunk_skylight_t skylight,
+		uint64_t light_stamp,
+		const std::array<uint64_t, 6>& neighbor_light_stamps,
+		const chunk_sky_floor_t& sky_floor
+	);
 
 	// for msgpack
 	template<typename T> void save(T&) const;
@@ -51,7 +217,14 @@ public:
 private:
 	friend class world::world;
 
-	chunk_blocks_t blocks; // this here (instead of in impl) for msgpack saving
+	// for world, when a chunk is put in or taken out of it
+	void set_neighbor(const glm::ivec3& offset, const std::shared_ptr<Chunk>&);
+	void clear_neighbors();
+
+	// these here (instead of in impl) for msgpack saving
+	chunk_blocks_t blocks;
+	chunk_light_t blocklight;
+	chunk_skylight_t skylight;
 
 	struct impl;
 	std::propagate_const<std::unique_ptr<impl>> pImpl;
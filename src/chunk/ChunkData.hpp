@@ -1,10 +1,16 @@
 #pragma once
 
-#include <algorithm>
-#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "game.hpp"
 #include "block/base.hpp"
@@ -12,14 +18,55 @@
 #include "block/enums/type.hpp"
 #include "fwd/chunk/Chunk.hpp"
 #include "position/block_in_chunk.hpp"
+#include "util/epoch.hpp"
 
 namespace block_thingy {
 
+/**
+ * Stores one value per block of a chunk as a palette of distinct values plus
+ * bit-packed indices into that palette. The index width starts at 1 bit and
+ * doubles (up to 16 bits) when the palette outgrows it.
+ * The palette only doubles when it is full, so it is not as big as the index width allows
+ * (light, for example, can have a few hundred colors, which need 16 bit indices).
+ * When every block has the same value, no indices are stored at all.
+ *
+ * Reads do not lock. Writers are serialized by a mutex and bump a sequence
+ * number around each change; readers retry if it changed while they read.
+ * Replaced palette entries and arrays are freed through util::epoch once no
+ * reader can see them.
+ */
 template<typename T>
 class ChunkData
 {
 public:
+	using palette_index_t = uint16_t;
+
+	/**
+	 * A consistent copy of all values, made by `copy_out`
+	 */
+	struct snapshot
+	{
+		std::vector<T> palette;
+		std::vector<palette_index_t> indices; // empty if every block uses palette[0]
+
+		// only for a copy of the whole chunk
+		const T& get(const position::block_in_chunk& pos) const
+		{
+			return (*this)[block_array_index(pos.x, pos.y, pos.z)];
+		}
+
+		// same order as the storage (x major, z minor), within the box for a copy of part of the chunk
+		const T& operator[](const std::size_t i) const
+		{
+			return palette[indices.empty() ? 0 : indices[i]];
+		}
+	};
+
 	ChunkData()
+	:
+		palette(nullptr),
+		indices(nullptr),
+		sequence(0)
 	{
 		// explicit template instantiation does not work with both MSVC and GCC/Clang
 		// with MSVC, putting a prototype in this file with the definition in a cpp file causes a linking error
@@ -28,54 +75,212 @@ public:
 		{
 			fill(game::instance->block_registry.get_default(block::enums::type::air));
 		}
+		else
+		{
+			fill(T());
+		}
 	}
 
 	ChunkData(T block)
+	:
+		palette(nullptr),
+		indices(nullptr),
+		sequence(0)
 	{
 		fill(std::move(block));
 	}
 
+	~ChunkData()
+	{
+		// nothing can be reading while the data is destroyed
+		delete_palette(palette.load(std::memory_order_relaxed), true);
+		delete indices.load(std::memory_order_relaxed);
+	}
+
 	ChunkData(ChunkData&& that)
 	:
-		blocks(std::move(that.blocks))
+		palette(that.palette.exchange(nullptr)),
+		indices(that.indices.exchange(nullptr)),
+		sequence(0),
+		palette_refs(std::move(that.palette_refs))
 	{
 	}
 	ChunkData& operator=(ChunkData&& that)
 	{
 		std::lock_guard<std::mutex> g(blocks_mutex);
-		blocks = std::move(that.blocks);
+		write_begin();
+		palette_refs = std::move(that.palette_refs);
+		replace(that.palette.exchange(nullptr), that.indices.exchange(nullptr));
+		write_end();
 		return *this;
 	}
 
 	ChunkData(const ChunkData&) = delete;
 	ChunkData& operator=(const ChunkData&) = delete;
 
-	const T& get(const position::block_in_chunk& pos) const
+	T get(const position::block_in_chunk& pos) const
 	{
-		std::lock_guard<std::mutex> g(blocks_mutex);
-		return blocks[block_array_index(pos.x, pos.y, pos.z)];
+		util::epoch::guard g;
+		return get_guarded(block_array_index(pos.x, pos.y, pos.z));
 	}
 
-	T& get(const position::block_in_chunk& pos)
+	/**
+	 * Reads many values with one epoch guard, for loops that read block by block.
+	 * The values it returns stay valid while it exists, so they are not copied.
+	 * It holds back freeing replaced values, so only keep it for a loop.
+	 */
+	class reader
 	{
-		std::lock_guard<std::mutex> g(blocks_mutex);
-		return blocks[block_array_index(pos.x, pos.y, pos.z)];
+	public:
+		explicit reader(const ChunkData& data)
+		:
+			data(data)
+		{
+		}
+
+		const T& get(const position::block_in_chunk& pos) const
+		{
+			return data.get_guarded(block_array_index(pos.x, pos.y, pos.z));
+		}
+
+	private:
+		const ChunkData& data;
+		util::epoch::guard g;
+	};
+
+	reader read() const
+	{
+		return reader(*this);
 	}
 
 	void set(const position::block_in_chunk& pos, T block)
 	{
 		const std::size_t i = block_array_index(pos.x, pos.y, pos.z);
 		std::lock_guard<std::mutex> g(blocks_mutex);
-		blocks[i] = std::move(block);
+
+		const palette_index_t old_index = indices.load(std::memory_order_relaxed)->get(i);
+		if(*get_entry(old_index) == block)
+		{
+			return;
+		}
+
+		write_begin();
+		set_locked(i, old_index, std::move(block));
+		write_end();
+	}
+
+	/**
+	 * Set many values with one lock and one write, so readers retry at most once.
+	 * Each index is in the storage order (x major, z minor).
+	 */
+	void set(const std::vector<std::pair<std::size_t, T>>& values)
+	{
+		std::lock_guard<std::mutex> g(blocks_mutex);
+		write_begin();
+		for(const auto& p : values)
+		{
+			assert(p.first < static_cast<std::size_t>(CHUNK_BLOCK_COUNT));
+			const palette_index_t old_index = indices.load(std::memory_order_relaxed)->get(p.first);
+			if(*get_entry(old_index) != p.second)
+			{
+				set_locked(p.first, old_index, p.second);
+			}
+		}
+		write_end();
 	}
 
 	void fill(T block)
 	{
 		std::lock_guard<std::mutex> g(blocks_mutex);
-		std::generate(blocks.begin(), blocks.end(), [&block]()
+		write_begin();
+		make_uniform(std::move(block));
+		write_end();
+	}
+
+	/**
+	 * @return The value of every block if they are all the same, or `std::nullopt` otherwise
+	 */
+	std::optional<T> get_uniform() const
+	{
+		util::epoch::guard g;
+		while(true)
 		{
-			return block;
-		});
+			const uint32_t seq = read_begin();
+			const bool uniform = indices.load(std::memory_order_acquire)->bits == 0;
+			const T* value = palette.load(std::memory_order_acquire)->entries[0].load(std::memory_order_acquire);
+			if(read_end(seq))
+			{
+				if(!uniform)
+				{
+					return std::nullopt;
+				}
+				assert(value != nullptr);
+				return *value;
+			}
+		}
+	}
+
+	/**
+	 * Copy every value with one consistent read. The palette is copied once instead of copying a value per block.
+	 */
+	snapshot copy_out() const
+	{
+		constexpr auto last = static_cast<position::block_in_chunk::value_type>(CHUNK_SIZE - 1);
+		return copy_out({0, 0, 0}, {last, last, last});
+	}
+
+	/**
+	 * Copy the values of a box of blocks (from `min` to `max`, both included) with one consistent read,
+	 * such as the side of a chunk that touches its neighbour.
+	 * The indices of the snapshot are in the order of the box (x major, z minor), so use its operator[] instead of get.
+	 */
+	snapshot copy_out(const position::block_in_chunk& min, const position::block_in_chunk& max) const
+	{
+		assert(min.x <= max.x && min.y <= max.y && min.z <= max.z);
+		assert(max.x < CHUNK_SIZE && max.y < CHUNK_SIZE && max.z < CHUNK_SIZE);
+		const std::size_t count = std::size_t(max.x - min.x + 1) * std::size_t(max.y - min.y + 1) * std::size_t(max.z - min.z + 1);
+
+		snapshot s;
+		std::vector<const T*> entries;
+		util::epoch::guard g;
+		while(true)
+		{
+			const uint32_t seq = read_begin();
+			const index_array* idx = indices.load(std::memory_order_acquire);
+			const palette_array* pal = palette.load(std::memory_order_acquire);
+			entries.resize(pal->capacity);
+			for(std::size_t i = 0; i < pal->capacity; ++i)
+			{
+				entries[i] = pal->entries[i].load(std::memory_order_acquire);
+			}
+			if(idx->bits == 0)
+			{
+				s.indices.clear();
+			}
+			else
+			{
+				s.indices.resize(count);
+				std::size_t i = 0;
+				for(auto x = min.x; x <= max.x; ++x)
+				for(auto y = min.y; y <= max.y; ++y)
+				for(auto z = min.z; z <= max.z; ++z)
+				{
+					s.indices[i++] = idx->get(block_array_index(x, y, z));
+				}
+			}
+			if(read_end(seq))
+			{
+				break;
+			}
+		}
+
+		s.palette.reserve(entries.size());
+		for(const T* value : entries)
+		{
+			// empty slots are not referenced by any index
+			s.palette.emplace_back(value != nullptr ? *value : T());
+		}
+		return s;
 	}
 
 	// for msgpack
@@ -83,9 +288,293 @@ public:
 	template<typename O> void load(const O&);
 
 private:
-	std::array<T, CHUNK_BLOCK_COUNT> blocks;
+	struct palette_array
+	{
+		explicit palette_array(const std::size_t capacity)
+		:
+			capacity(capacity),
+			entries(std::make_unique<std::atomic<const T*>[]>(capacity))
+		{
+			for(std::size_t i = 0; i < capacity; ++i)
+			{
+				entries[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		const std::size_t capacity;
+
+		// nullptr for unused slots
+		// the values are owned by ChunkData, not by this array
+		std::unique_ptr<std::atomic<const T*>[]> entries;
+	};
+
+	struct index_array
+	{
+		explicit index_array(const uint8_t bits)
+		:
+			bits(bits),
+			word_count(static_cast<std::size_t>(CHUNK_BLOCK_COUNT) * bits / 64),
+			words(std::make_unique<std::atomic<uint64_t>[]>(word_count))
+		{
+			for(std::size_t i = 0; i < word_count; ++i)
+			{
+				words[i].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		// bits is always 0 or a power of 2, so an index never straddles two words
+		palette_index_t get(const std::size_t i) const
+		{
+			if(bits == 0)
+			{
+				return 0;
+			}
+			const std::size_t per_word = 64u / bits;
+			const uint64_t mask = (uint64_t(1) << bits) - 1;
+			const uint64_t word = words[i / per_word].load(std::memory_order_acquire);
+			return static_cast<palette_index_t>((word >> ((i % per_word) * bits)) & mask);
+		}
+
+		// only writers call this, and they are serialized, so the read-modify-write does not need to be atomic
+		void set(const std::size_t i, const palette_index_t index)
+		{
+			assert(bits != 0);
+			const std::size_t per_word = 64u / bits;
+			const uint64_t mask = (uint64_t(1) << bits) - 1;
+			const std::size_t shift = (i % per_word) * bits;
+			std::atomic<uint64_t>& word = words[i / per_word];
+			const uint64_t old_word = word.load(std::memory_order_relaxed);
+			word.store((old_word & ~(mask << shift)) | (static_cast<uint64_t>(index) << shift), std::memory_order_release);
+		}
+
+		const uint8_t bits; // 0 means every block uses palette slot 0
+		const std::size_t word_count;
+		std::unique_ptr<std::atomic<uint64_t>[]> words;
+	};
+
+	std::atomic<palette_array*> palette;
+	std::atomic<index_array*> indices;
+	std::atomic<uint32_t> sequence; // odd while a write is in progress
+
+	// these are only used by writers
+	std::vector<uint32_t> palette_refs; // the size is the amount of palette slots in use (including freed ones)
 	mutable std::mutex blocks_mutex;
 
+	uint32_t read_begin() const
+	{
+		uint32_t seq;
+		while((seq = sequence.load(std::memory_order_acquire)) % 2 != 0)
+		{
+			std::this_thread::yield();
+		}
+		return seq;
+	}
+
+	bool read_end(const uint32_t seq) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return sequence.load(std::memory_order_relaxed) == seq;
+	}
+
+	void write_begin()
+	{
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void write_end()
+	{
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// the caller holds an epoch guard, which keeps the value alive
+	const T& get_guarded(const std::size_t i) const
+	{
+		while(true)
+		{
+			const uint32_t seq = read_begin();
+			const palette_index_t index = indices.load(std::memory_order_acquire)->get(i);
+			const palette_array* pal = palette.load(std::memory_order_acquire);
+			// an inconsistent read can see an index that is out of range or a slot that is empty
+			const T* value = (index < pal->capacity) ? pal->entries[index].load(std::memory_order_acquire) : nullptr;
+			if(read_end(seq) && value != nullptr)
+			{
+				return *value;
+			}
+		}
+	}
+
+	// for writers only
+	const T* get_entry(const palette_index_t index) const
+	{
+		return palette.load(std::memory_order_relaxed)->entries[index].load(std::memory_order_relaxed);
+	}
+
+	static void delete_palette(palette_array* pal, const bool with_values)
+	{
+		if(pal == nullptr)
+		{
+			return;
+		}
+		if(with_values)
+		{
+			for(std::size_t i = 0; i < pal->capacity; ++i)
+			{
+				delete pal->entries[i].load(std::memory_order_relaxed);
+			}
+		}
+		delete pal;
+	}
+
+	static void retire(const T* value)
+	{
+		util::epoch::retire([value]()
+		{
+			delete value;
+		});
+	}
+
+	static void retire(palette_array* pal, const bool with_values)
+	{
+		if(pal == nullptr)
+		{
+			return;
+		}
+		util::epoch::retire([pal, with_values]()
+		{
+			delete_palette(pal, with_values);
+		});
+	}
+
+	static void retire(index_array* idx)
+	{
+		if(idx == nullptr)
+		{
+			return;
+		}
+		util::epoch::retire([idx]()
+		{
+			delete idx;
+		});
+	}
+
+	// publish new arrays (whose values are owned by this) and retire the old ones along with their values
+	void replace(palette_array* new_palette, index_array* new_indices)
+	{
+		retire(palette.exchange(new_palette, std::memory_order_acq_rel), true);
+		retire(indices.exchange(new_indices, std::memory_order_acq_rel));
+	}
+
+	void make_uniform(T value)
+	{
+		auto new_palette = std::make_unique<palette_array>(1);
+		new_palette->entries[0].store(new T(std::move(value)), std::memory_order_relaxed);
+		palette_refs.assign(1, static_cast<uint32_t>(CHUNK_BLOCK_COUNT));
+		replace(new_palette.release(), new index_array(0));
+	}
+
+	// double the palette capacity
+	void grow_palette()
+	{
+		const palette_array* old_palette = palette.load(std::memory_order_relaxed);
+		auto new_palette = std::make_unique<palette_array>(old_palette->capacity * 2);
+		for(std::size_t i = 0; i < old_palette->capacity; ++i)
+		{
+			new_palette->entries[i].store(old_palette->entries[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		// the values now belong to the new palette, so only the old array is retired
+		retire(palette.exchange(new_palette.release(), std::memory_order_acq_rel), false);
+	}
+
+	// widen the indices to the next size
+	void grow_indices()
+	{
+		const index_array* old_indices = indices.load(std::memory_order_relaxed);
+		const uint8_t new_bits = static_cast<uint8_t>(old_indices->bits == 0 ? 1 : old_indices->bits * 2);
+		assert(new_bits <= 16);
+
+		auto new_indices = std::make_unique<index_array>(new_bits);
+		for(std::size_t i = 0; i < static_cast<std::size_t>(CHUNK_BLOCK_COUNT); ++i)
+		{
+			new_indices->set(i, old_indices->get(i));
+		}
+		retire(indices.exchange(new_indices.release(), std::memory_order_acq_rel));
+	}
+
+	static std::size_t palette_capacity(const std::size_t size)
+	{
+		std::size_t capacity = 1;
+		while(capacity < size)
+		{
+			capacity *= 2;
+		}
+		return capacity;
+	}
+
+	// for writers only, between write_begin and write_end
+	void set_locked(const std::size_t i, const palette_index_t old_index, T block)
+	{
+		const palette_index_t new_index = palette_add(std::move(block));
+		indices.load(std::memory_order_relaxed)->set(i, new_index);
+		palette_release(old_index);
+		if(palette_refs[new_index] == static_cast<uint32_t>(CHUNK_BLOCK_COUNT))
+		{
+			make_uniform(*get_entry(new_index));
+		}
+	}
+
+	palette_index_t palette_add(T value)
+	{
+		const palette_array* pal = palette.load(std::memory_order_relaxed);
+		std::size_t free_slot = palette_refs.size();
+		for(std::size_t i = 0; i < palette_refs.size(); ++i)
+		{
+			if(palette_refs[i] == 0)
+			{
+				if(free_slot == palette_refs.size())
+				{
+					free_slot = i;
+				}
+			}
+			else if(*pal->entries[i].load(std::memory_order_relaxed) == value)
+			{
+				palette_refs[i] += 1;
+				return static_cast<palette_index_t>(i);
+			}
+		}
+
+		if(free_slot == palette_refs.size())
+		{
+			// there are at most CHUNK_BLOCK_COUNT distinct values, and a value is added before the old one is released
+			assert(palette_refs.size() <= static_cast<std::size_t>(CHUNK_BLOCK_COUNT));
+			if(palette_refs.size() == pal->capacity)
+			{
+				grow_palette();
+				pal = palette.load(std::memory_order_relaxed);
+			}
+			if(palette_refs.size() == std::size_t(1) << indices.load(std::memory_order_relaxed)->bits)
+			{
+				grow_indices();
+			}
+			palette_refs.emplace_back(0);
+		}
+		pal->entries[free_slot].store(new T(std::move(value)), std::memory_order_release);
+		palette_refs[free_slot] = 1;
+		return static_cast<palette_index_t>(free_slot);
+	}
+
+	void palette_release(const palette_index_t index)
+	{
+		assert(palette_refs[index] != 0);
+		palette_refs[index] -= 1;
+		if(palette_refs[index] == 0)
+		{
+			// do not keep unused values (such as block instances) alive
+			retire(palette.load(std::memory_order_relaxed)->entries[index].exchange(nullptr, std::memory_order_acq_rel));
+		}
+	}
+
 	static std::size_t block_array_index
 	(
 		const position::block_in_chunk::value_type x,
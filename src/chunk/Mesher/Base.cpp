@@ -5,11 +5,7 @@
 #include "block/base.hpp"
 #include "block/enums/Face.hpp"
 #include "block/enums/type.hpp"
-#include "chunk/Chunk.hpp"
-#include "position/block_in_chunk.hpp"
-#include "position/block_in_world.hpp"
-#include "position/chunk_in_world.hpp"
-#include "world/world.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
 
 namespace block_thingy::mesher {
 
@@ -33,6 +29,34 @@ mesh_vertex_t::mesh_vertex_t
 {
 }
 
+mesh_packed_vertex_t pack_vertex(const mesh_vertex_t& v)
+{
+	// a position can be CHUNK_SIZE (the far side of the last block)
+	assert(v.pos.x < 64 && v.pos.y < 64 && v.pos.z < 64);
+	assert(v.face_and_rotation < 32);
+	assert(v.tex_index < 512);
+	return static_cast<mesh_packed_vertex_t>(v.pos.x)
+		 | static_cast<mesh_packed_vertex_t>(v.pos.y) << 6
+		 | static_cast<mesh_packed_vertex_t>(v.pos.z) << 12
+		 | static_cast<mesh_packed_vertex_t>(v.face_and_rotation) << 18
+		 | static_cast<mesh_packed_vertex_t>(v.tex_index) << 23;
+}
+
+bool can_pack(const mesh_t& mesh)
+{
+	for(const mesh_quad_t& quad : mesh)
+	{
+		for(const mesh_vertex_t& v : quad)
+		{
+			if(v.tex_index >= 512)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
 Base::Base()
 {
 }
@@ -50,8 +74,7 @@ static void add_square
 	const mesh_vertex_t& p4
 )
 {
-	mesh.emplace_back(p1, p2, p3);
-	mesh.emplace_back(p3, p4, p1);
+	mesh.push_back({{p1, p2, p3, p4}});
 }
 
 void Base::add_face
@@ -126,45 +149,26 @@ Side Base::to_side(const Face face)
 	return (face == Face::top || face == Face::front || face == Face::right) ? Side::top : Side::bottom;
 }
 
-const block::base& Base::block_at
-(
-	const Chunk& chunk,
-	const int_fast16_t x,
-	const int_fast16_t y,
-	const int_fast16_t z
-)
+bool Base::face_visible(const block::base& block, const block::base& sibling)
 {
-	if(x < 0 || x >= CHUNK_SIZE
-	|| y < 0 || y >= CHUNK_SIZE
-	|| z < 0 || z >= CHUNK_SIZE)
-	{
-		position::block_in_world block_pos(chunk.get_position(), {});
-		block_pos.x += x;
-		block_pos.y += y;
-		block_pos.z += z;
-		return *chunk.get_owner().get_block(block_pos);
-	}
-	#define s(a) static_cast<position::block_in_chunk::value_type>(a)
-	return *chunk.get_block({s(x), s(y), s(z)});
-	#undef s
+	return
+		   sibling.type() != block::enums::type::none
+		&& !block.is_invisible() // this block is visible
+		&& !sibling.is_opaque() // this block can be seen thru the adjacent block
+		&& block.type() != sibling.type() // do not show sides inside of adjacent translucent blocks (of the same type)
+	;
 }
 
 bool Base::block_visible_from
 (
-	const Chunk& chunk,
+	const padded_chunk& blocks,
 	const block::base& block,
 	const int_fast16_t x,
 	const int_fast16_t y,
 	const int_fast16_t z
 )
 {
-	const block::base& sibling = block_at(chunk, x, y, z);
-	return
-		   sibling.type() != block::enums::type::none
-		&& !block.is_invisible() // this block is visible
-		&& !sibling.is_opaque() // this block can be seen thru the adjacent block
-		&& block.type() != sibling.type() // do not show sides inside of adjacent translucent blocks (of the same type)
-	;
+	return face_visible(block, blocks.get(x, y, z));
 }
 
 }
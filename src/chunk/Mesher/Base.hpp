@@ -1,8 +1,9 @@
 #pragma once
 
-#include <map>
+#include <array>
+#include <cstddef>
 #include <stdint.h>
-#include <tuple>
+#include <utility>
 #include <vector>
 
 #include <glm/vec3.hpp>
@@ -10,8 +11,9 @@
 #include "fwd/block/base.hpp"
 #include "fwd/block/enums/Face.hpp"
 #include "fwd/chunk/Chunk.hpp"
+#include "fwd/chunk/Mesher/Base.hpp"
+#include "fwd/chunk/Mesher/padded_chunk.hpp"
 #include "graphics/primitive.hpp"
-#include "util/filesystem.hpp"
 
 namespace block_thingy::mesher {
 
@@ -38,29 +40,92 @@ struct mesh_vertex_t
 
 struct meshmap_key_t
 {
-	fs::path shader_path;
+	material_id_t material; // from resource_manager::get_material_id; 0 means nothing is drawn
 	bool is_translucent;
 	uint8_t tex_unit;
 
 	bool operator==(const meshmap_key_t& that) const
 	{
 		return
-			shader_path == that.shader_path
+			material == that.material
 		 && is_translucent == that.is_translucent
 		 && tex_unit == that.tex_unit;
 	}
-
-	// for std::map
-	bool operator<(const meshmap_key_t& that) const
+	bool operator!=(const meshmap_key_t& that) const
 	{
-		return std::tie(shader_path, is_translucent, tex_unit)
-			 < std::tie(that.shader_path, that.is_translucent, that.tex_unit);
+		return !(*this == that);
 	}
 };
 
-using mesh_triangle_t = glm::tvec3<mesh_vertex_t>;
-using mesh_t = std::vector<mesh_triangle_t>;
-using meshmap_t = std::map<meshmap_key_t, mesh_t>;
+/**
+ * A face is stored as its 4 corners, in winding order.
+ * Chunk draws them with `quad_indices` (shared by every quad) instead of repeating 2 corners per face.
+ */
+using mesh_quad_t = std::array<mesh_vertex_t, 4>;
+using mesh_t = std::vector<mesh_quad_t>;
+static_assert(sizeof(mesh_quad_t) == 4 * sizeof(mesh_vertex_t)); // uploaded as is
+
+constexpr std::array<uint8_t, 6> quad_indices {{0, 1, 2, 2, 3, 0}};
+
+/**
+ * 32 bits: x, y, z (6 bits each), face (3 bits), rotation (2 bits), texture index (9 bits)
+ */
+using mesh_packed_vertex_t = uint32_t;
+mesh_packed_vertex_t pack_vertex(const mesh_vertex_t&);
+
+/**
+ * @return Whether every vertex of the mesh fits in mesh_packed_vertex_t, which is not so for texture indexes past 511
+ */
+bool can_pack(const mesh_t&);
+
+/**
+ * A chunk has only a few distinct keys, so this is a flat vector searched linearly instead of a tree
+ */
+class meshmap_t
+{
+public:
+	using value_type = std::pair<meshmap_key_t, mesh_t>;
+	using const_iterator = std::vector<value_type>::const_iterator;
+
+	mesh_t& operator[](const meshmap_key_t& key)
+	{
+		for(value_type& p : meshes)
+		{
+			if(p.first == key)
+			{
+				return p.second;
+			}
+		}
+		meshes.emplace_back(key, mesh_t());
+		return meshes.back().second;
+	}
+
+	const_iterator begin() const
+	{
+		return meshes.cbegin();
+	}
+	const_iterator end() const
+	{
+		return meshes.cend();
+	}
+
+	std::size_t size() const
+	{
+		return meshes.size();
+	}
+	bool empty() const
+	{
+		return meshes.empty();
+	}
+
+	void clear()
+	{
+		meshes.clear();
+	}
+
+private:
+	std::vector<value_type> meshes;
+};
 
 enum class Plane
 {
@@ -86,7 +151,7 @@ public:
 	Base& operator=(Base&&) = delete;
 	Base& operator=(const Base&) = delete;
 
-	virtual meshmap_t make_mesh(const Chunk&) = 0;
+	virtual meshmap_t make_mesh(const padded_chunk&) = 0;
 
 	static void add_face
 	(
@@ -102,8 +167,11 @@ public:
 
 	static Side to_side(block::enums::Face);
 
-	static const block::base& block_at(const Chunk&, int_fast16_t x, int_fast16_t y, int_fast16_t z);
-	static bool block_visible_from(const Chunk&, const block::base&, int_fast16_t, int_fast16_t, int_fast16_t);
+	/**
+	 * @return Whether the face of `block` that touches `sibling` is drawn
+	 */
+	static bool face_visible(const block::base& block, const block::base& sibling);
+	static bool block_visible_from(const padded_chunk&, const block::base&, int_fast16_t, int_fast16_t, int_fast16_t);
 };
 
 }
@@ -0,0 +1,226 @@
+#include "Binary.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+#include "game.hpp"
+#include "block/base.hpp"
+#include "block/enums/Face.hpp"
+#include "block/enums/type.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
+#include "chunk/Mesher/render_traits.hpp"
+
+namespace block_thingy::mesher {
+
+using block::enums::Face;
+
+// one bit per block along an axis, including the border
+using column_t = uint64_t;
+static_assert(CHUNK_SIZE + 2 <= 64, "a column must fit in column_t");
+using columns_t = std::array<std::array<column_t, CHUNK_SIZE>, CHUNK_SIZE>;
+
+// one bit per block along a row of a layer
+using row_t = uint32_t;
+static_assert(CHUNK_SIZE <= 32, "a row must fit in row_t");
+using layers_t = std::array<std::array<row_t, CHUNK_SIZE>, CHUNK_SIZE>;
+
+static int count_trailing_zeros(const uint64_t x)
+{
+	assert(x != 0);
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return static_cast<int>(i);
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+meshmap_t Binary::make_mesh(const padded_chunk& blocks)
+{
+	// a face of each axis, for getting the order of the axes with get_i
+	constexpr std::array<Face, 3> axis_faces
+	{{
+		Face::right,
+		Face::top,
+		Face::front,
+	}};
+
+	// per axis, a column for each position on the other 2 axes (in get_i order)
+	std::array<columns_t, 3> visible{};     // the block has faces
+	std::array<columns_t, 3> hiding{};      // the block hides the faces next to it
+	std::array<columns_t, 3> see_through{}; // the block has faces but does not hide the faces next to it
+
+	// only the blocks in the bounds have faces, but the blocks next to them can hide those faces
+	const auto& min = blocks.mesh_min();
+	const auto& max = blocks.mesh_max();
+	for(int_fast16_t x = min.x - 1; x <= max.x; ++x)
+	for(int_fast16_t y = min.y - 1; y <= max.y; ++y)
+	for(int_fast16_t z = min.z - 1; z <= max.z; ++z)
+	{
+		const block::base& block = blocks.get(x, y, z);
+		const bool is_visible = !block.is_invisible();
+		const bool hides = block.type() == block::enums::type::none || block.is_opaque();
+		if(!is_visible && !hides)
+		{
+			continue;
+		}
+
+		const glm::tvec3<int_fast16_t> pos(x, y, z);
+		for(std::size_t axis = 0; axis < 3; ++axis)
+		{
+			const u8vec3 i = get_i(axis_faces[axis]);
+			const int_fast16_t a = pos[i.x];
+			const int_fast16_t b = pos[i.z];
+			if(a < min[i.x] || a >= max[i.x]
+			|| b < min[i.z] || b >= max[i.z])
+			{
+				continue;
+			}
+			const column_t bit = column_t(1) << (pos[i.y] + 1);
+			if(is_visible)
+			{
+				visible[axis][a][b] |= bit;
+			}
+			if(hides)
+			{
+				hiding[axis][a][b] |= bit;
+			}
+			else if(is_visible)
+			{
+				see_through[axis][a][b] |= bit;
+			}
+		}
+	}
+
+	meshmap_t meshes;
+	const auto render_traits = game::instance->resource_manager.get_render_traits();
+
+	std::vector<face_traits_t> infos;
+	std::unordered_map<const block::base*, std::size_t> info_of_block;
+	std::vector<layers_t> face_masks; // per face info: a bit for each face with that info
+
+	for(uint8_t face_i = 0; face_i < 6; ++face_i)
+	{
+		const Face face = static_cast<Face>(face_i);
+		const Side side = to_side(face);
+		const u8vec3 i = get_i(face);
+		const std::size_t axis = i.y;
+
+		infos.clear();
+		info_of_block.clear();
+		face_masks.clear();
+
+		// line up each block with the block its face is next to
+		const auto to_sibling = [side](const column_t c)
+		{
+			return (side == Side::top) ? (c >> 1) : (c << 1);
+		};
+
+		// the bits for the blocks in the bounds (not the blocks next to them)
+		const column_t bounds_bits = ((column_t(1) << (max[axis] - min[axis])) - 1) << (min[axis] + 1);
+
+		for(int_fast16_t a = min[i.x]; a < max[i.x]; ++a)
+		for(int_fast16_t b = min[i.z]; b < max[i.z]; ++b)
+		{
+			column_t faces = visible[axis][a][b] & ~to_sibling(hiding[axis][a][b]) & bounds_bits;
+
+			// do not show sides inside of adjacent translucent blocks (of the same type)
+			column_t check = faces & see_through[axis][a][b] & to_sibling(see_through[axis][a][b]);
+			while(check != 0)
+			{
+				const int bit = count_trailing_zeros(check);
+				check &= check - 1;
+
+				glm::tvec3<int_fast16_t> pos;
+				pos[i.x] = a;
+				pos[i.y] = static_cast<int_fast16_t>(bit - 1);
+				pos[i.z] = b;
+				const block::base& block = blocks.get(pos.x, pos.y, pos.z);
+				pos[i.y] += static_cast<int_fast16_t>(side);
+				const block::base& sibling = blocks.get(pos.x, pos.y, pos.z);
+				if(block.type() == sibling.type())
+				{
+					faces &= ~(column_t(1) << bit);
+				}
+			}
+
+			while(faces != 0)
+			{
+				const int bit = count_trailing_zeros(faces);
+				faces &= faces - 1;
+
+				glm::tvec3<int_fast16_t> pos;
+				pos[i.x] = a;
+				pos[i.y] = static_cast<int_fast16_t>(bit - 1);
+				pos[i.z] = b;
+				const block::base& block = blocks.get(pos.x, pos.y, pos.z);
+
+				auto info_i = info_of_block.find(&block);
+				if(info_i == info_of_block.cend())
+				{
+					const face_traits_t& info = render_traits->get(block, face);
+					// different block instances often look the same, so they can be merged
+					std::size_t j = 0;
+					while(j < infos.size() && !(infos[j] == info))
+					{
+						++j;
+					}
+					if(j == infos.size())
+					{
+						infos.emplace_back(info);
+						face_masks.emplace_back();
+					}
+					info_i = info_of_block.emplace(&block, j).first;
+				}
+				face_masks[info_i->second][pos[i.y]][b] |= row_t(1) << a;
+			}
+		}
+
+		// merge each row with the rows after it while they have the same span of faces
+		for(std::size_t info_i = 0; info_i < infos.size(); ++info_i)
+		{
+			const face_traits_t& info = infos[info_i];
+			mesh_t& mesh = meshes[info.key];
+			for(int_fast16_t layer = min[axis]; layer < max[axis]; ++layer)
+			{
+				auto& rows = face_masks[info_i][layer];
+				for(int_fast16_t row = 0; row < CHUNK_SIZE; ++row)
+				{
+					while(rows[row] != 0)
+					{
+						const int start = count_trailing_zeros(rows[row]);
+						const int width = count_trailing_zeros(~(uint64_t(rows[row]) >> start));
+						const row_t span = static_cast<row_t>(((uint64_t(1) << width) - 1) << start);
+						rows[row] &= ~span;
+
+						int_fast16_t height = 1;
+						while(row + height < CHUNK_SIZE && (rows[row + height] & span) == span)
+						{
+							rows[row + height] &= ~span;
+							++height;
+						}
+
+						u8vec3 xyz;
+						xyz[i.x] = static_cast<uint8_t>(start);
+						xyz[i.y] = static_cast<uint8_t>(layer);
+						xyz[i.z] = static_cast<uint8_t>(row);
+						Base::add_face(mesh, xyz, face, static_cast<uint8_t>(width), static_cast<uint8_t>(height), info.tex_index, info.rotation);
+					}
+				}
+			}
+		}
+	}
+
+	return meshes;
+}
+
+}
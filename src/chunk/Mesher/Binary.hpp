@@ -0,0 +1,12 @@
+#pragma once
+#include "Base.hpp"
+
+namespace block_thingy::mesher {
+
+class Binary : public Base
+{
+public:
+	meshmap_t make_mesh(const padded_chunk&) override;
+};
+
+}
@@ -7,6 +7,8 @@
 #include "game.hpp"
 #include "block/base.hpp"
 #include "block/enums/Face.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
+#include "chunk/Mesher/render_traits.hpp"
 #include "position/block_in_chunk.hpp"
 
 namespace block_thingy::mesher {
@@ -25,28 +27,30 @@ struct Rectangle
 	uint8_t rotation;
 };
 
-static void add_surface(const Chunk&, meshmap_t&, surface_t&, Face);
+static void add_surface(const padded_chunk&, const render_traits&, meshmap_t&, surface_t&, Face);
 static Rectangle yield_rectangle(surface_t&);
-static void generate_surface(const Chunk&, surface_t&, u8vec3&, const u8vec3&, Face);
+static void generate_surface(const padded_chunk&, const render_traits&, surface_t&, u8vec3&, const u8vec3&, Face);
 
-meshmap_t Greedy::make_mesh(const Chunk& chunk)
+meshmap_t Greedy::make_mesh(const padded_chunk& blocks)
 {
 	meshmap_t meshes;
+	const auto traits = game::instance->resource_manager.get_render_traits();
 
 	surface_t surface;
-	add_surface(chunk, meshes, surface, Face::right );
-	add_surface(chunk, meshes, surface, Face::left  );
-	add_surface(chunk, meshes, surface, Face::top   );
-	add_surface(chunk, meshes, surface, Face::bottom);
-	add_surface(chunk, meshes, surface, Face::front );
-	add_surface(chunk, meshes, surface, Face::back  );
+	add_surface(blocks, *traits, meshes, surface, Face::right );
+	add_surface(blocks, *traits, meshes, surface, Face::left  );
+	add_surface(blocks, *traits, meshes, surface, Face::top   );
+	add_surface(blocks, *traits, meshes, surface, Face::bottom);
+	add_surface(blocks, *traits, meshes, surface, Face::front );
+	add_surface(blocks, *traits, meshes, surface, Face::back  );
 
 	return meshes;
 }
 
 void add_surface
 (
-	const Chunk& chunk,
+	const padded_chunk& blocks,
+	const render_traits& traits,
 	meshmap_t& meshes,
 	surface_t& surface,
 	const Face face
@@ -54,15 +58,16 @@ void add_surface
 {
 	const u8vec3 i = Base::get_i(face);
 
+	// a layer is on the axis i.y
 	u8vec3 pos;
-	for(pos[1] = 0; pos[1] < CHUNK_SIZE; ++pos[1])
+	for(pos[1] = static_cast<uint8_t>(blocks.mesh_min()[i.y]); pos[1] < blocks.mesh_max()[i.y]; ++pos[1])
 	{
-		generate_surface(chunk, surface, pos, i, face);
+		generate_surface(blocks, traits, surface, pos, i, face);
 
 		while(true)
 		{
 			const Rectangle rekt = yield_rectangle(surface);
-			if(rekt.key.shader_path.empty())
+			if(rekt.key.material == 0)
 			{
 				break;
 			}
@@ -79,7 +84,8 @@ void add_surface
 
 void generate_surface
 (
-	const Chunk& chunk,
+	const padded_chunk& blocks,
+	const render_traits& traits,
 	surface_t& surface,
 	u8vec3& pos,
 	const u8vec3& i,
@@ -88,6 +94,8 @@ void generate_surface
 {
 	const Side side = Base::to_side(face);
 	const auto offset = static_cast<int8_t>(side);
+	const auto& min = blocks.mesh_min();
+	const auto& max = blocks.mesh_max();
 	for(pos[0] = 0; pos[0] < CHUNK_SIZE; ++pos[0])
 	{
 		for(pos[2] = 0; pos[2] < CHUNK_SIZE; ++pos[2])
@@ -98,19 +106,20 @@ void generate_surface
 			int8_t o[] = {0, 0, 0};
 			o[i.y] = offset;
 
-			const block::base& block = Base::block_at(chunk, x, y, z);
-			if(Base::block_visible_from(chunk, block, x + o[0], y + o[1], z + o[2]))
+			const bool in_bounds =
+				   x >= min.x && x < max.x
+				&& y >= min.y && y < max.y
+				&& z >= min.z && z < max.z;
+
+			const block::base& block = blocks.get(x, y, z);
+			if(in_bounds && Base::block_visible_from(blocks, block, x + o[0], y + o[1], z + o[2]))
 			{
-				const auto tex = game::instance->resource_manager.get_block_texture(block.texture(face));
+				const face_traits_t& t = traits.get(block, face);
 				surface[pos[2]][pos[0]] =
 				{
-					{
-						block.shader(face),
-						block.is_translucent(),
-						tex.unit,
-					},
-					tex.index,
-					block.rotation(face),
+					t.key,
+					t.tex_index,
+					t.rotation,
 				};
 			}
 			else
@@ -138,8 +147,7 @@ Rectangle yield_rectangle(surface_t& surface)
 		for(block_in_chunk::value_type x = 0; x < CHUNK_SIZE; ++x)
 		{
 			const auto key = row[x];
-			const fs::path shader_path = std::get<0>(key).shader_path;
-			if(shader_path.empty())
+			if(std::get<0>(key).material == 0)
 			{
 				continue;
 			}
@@ -147,12 +155,12 @@ Rectangle yield_rectangle(surface_t& surface)
 			const block_in_chunk::value_type start_x = x;
 			block_in_chunk::value_type w = 1;
 			block_in_chunk::value_type h = 1;
-			std::get<0>(row[x]).shader_path.clear();
+			std::get<0>(row[x]).material = 0;
 			++x;
 			while(x < CHUNK_SIZE && row[x] == key)
 			{
 				w += 1;
-				std::get<0>(row[x]).shader_path.clear();
+				std::get<0>(row[x]).material = 0;
 				++x;
 			}
 			++z;
@@ -179,7 +187,7 @@ Rectangle yield_rectangle(surface_t& surface)
 				}
 				for(block_in_chunk::value_type i = start_x; i < start_x + w2; ++i)
 				{
-					std::get<0>(row2[start_x]).shader_path.clear();
+					std::get<0>(row2[start_x]).material = 0;
 				}
 
 				++z;
@@ -188,7 +196,7 @@ Rectangle yield_rectangle(surface_t& surface)
 			return
 			{
 				{
-					std::get<0>(key).shader_path,
+					std::get<0>(key).material,
 					std::get<0>(key).is_translucent,
 					std::get<0>(key).tex_unit,
 				},
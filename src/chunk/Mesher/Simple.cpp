@@ -2,7 +2,8 @@
 
 #include "game.hpp"
 #include "block/base.hpp"
-#include "chunk/Chunk.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
+#include "chunk/Mesher/render_traits.hpp"
 #include "position/block_in_chunk.hpp"
 
 namespace block_thingy::mesher {
@@ -10,14 +11,17 @@ namespace block_thingy::mesher {
 using block::enums::Face;
 using position::block_in_chunk;
 
-meshmap_t Simple::make_mesh(const Chunk& chunk)
+meshmap_t Simple::make_mesh(const padded_chunk& blocks)
 {
 	meshmap_t meshes;
-	for(block_in_chunk::value_type x = 0; x < CHUNK_SIZE; ++x)
-	for(block_in_chunk::value_type y = 0; y < CHUNK_SIZE; ++y)
-	for(block_in_chunk::value_type z = 0; z < CHUNK_SIZE; ++z)
+	const auto render_traits = game::instance->resource_manager.get_render_traits();
+	const auto& min = blocks.mesh_min();
+	const auto& max = blocks.mesh_max();
+	for(auto x = static_cast<block_in_chunk::value_type>(min.x); x < max.x; ++x)
+	for(auto y = static_cast<block_in_chunk::value_type>(min.y); y < max.y; ++y)
+	for(auto z = static_cast<block_in_chunk::value_type>(min.z); z < max.z; ++z)
 	{
-		const block::base& block = *chunk.get_block({x, y, z});
+		const block::base& block = blocks.get(x, y, z);
 		if(block.is_invisible())
 		{
 			continue;
@@ -30,16 +34,10 @@ meshmap_t Simple::make_mesh(const Chunk& chunk)
 			const auto i = get_i(face);
 			glm::tvec3<int8_t> pos(x, y, z);
 			pos[i.y] += static_cast<int8_t>(side);
-			if(block_visible_from(chunk, block, pos.x, pos.y, pos.z))
+			if(block_visible_from(blocks, block, pos.x, pos.y, pos.z))
 			{
-				const auto tex = game::instance->resource_manager.get_block_texture(block.texture(face));
-				const meshmap_key_t key =
-				{
-					block.shader(face),
-					block.is_translucent(),
-					tex.unit,
-				};
-				Base::add_face(meshes[key], {x, y, z}, face, 1, 1, tex.index, block.rotation(face));
+				const face_traits_t& traits = render_traits->get(block, face);
+				Base::add_face(meshes[traits.key], {x, y, z}, face, 1, 1, traits.tex_index, traits.rotation);
 			}
 		}
 	}
@@ -6,7 +6,7 @@ namespace block_thingy::mesher {
 class Simple : public Base
 {
 public:
-	meshmap_t make_mesh(const Chunk&) override;
+	meshmap_t make_mesh(const padded_chunk&) override;
 };
 
 }
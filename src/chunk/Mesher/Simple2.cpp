@@ -6,7 +6,8 @@
 #include "game.hpp"
 #include "block/base.hpp"
 #include "block/enums/type.hpp"
-#include "chunk/Chunk.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
+#include "chunk/Mesher/render_traits.hpp"
 #include "position/block_in_chunk.hpp"
 
 namespace block_thingy::mesher {
@@ -14,68 +15,52 @@ namespace block_thingy::mesher {
 using block::enums::Face;
 using position::block_in_chunk;
 
-meshmap_t Simple2::make_mesh(const Chunk& chunk)
+meshmap_t Simple2::make_mesh(const padded_chunk& blocks)
 {
 	meshmap_t meshes;
+	const auto render_traits = game::instance->resource_manager.get_render_traits();
 
-	std::array<block::base*, CHUNK_BLOCK_COUNT> cache;
+	// the difference between the index of a block and the index of its neighbour, per face
+	constexpr std::ptrdiff_t S = padded_chunk::SIZE;
+	constexpr std::array<std::ptrdiff_t, 6> sibling_offset
+	{{
+		+S * S, // right
+		-S * S, // left
+		+S,     // top
+		-S,     // bottom
+		+1,     // front
+		-1,     // back
+	}};
 
-	std::size_t block_i = 0;
-	block_in_chunk c_pos(0, 0, 0);
-	for(c_pos.x = 0; c_pos.x < CHUNK_SIZE; ++c_pos.x)
-	for(c_pos.y = 0; c_pos.y < CHUNK_SIZE; ++c_pos.y)
-	for(c_pos.z = 0; c_pos.z < CHUNK_SIZE; ++c_pos.z, ++block_i)
+	const auto& min = blocks.mesh_min();
+	const auto& max = blocks.mesh_max();
+	for(auto x = static_cast<block_in_chunk::value_type>(min.x); x < max.x; ++x)
+	for(auto y = static_cast<block_in_chunk::value_type>(min.y); y < max.y; ++y)
 	{
-		cache[block_i] = chunk.get_block(c_pos).get();
-	}
-
-	block_i = 0;
-	for(block_in_chunk::value_type x = 0; x < CHUNK_SIZE; ++x)
-	for(block_in_chunk::value_type y = 0; y < CHUNK_SIZE; ++y)
-	for(block_in_chunk::value_type z = 0; z < CHUNK_SIZE; ++z, ++block_i)
-	{
-		const block::base& block = *cache[block_i];
-		if(block.is_invisible())
-		{
-			continue;
-		}
-
-		for(uint8_t face_i = 0; face_i < 6; ++face_i)
+		const auto min_z = static_cast<block_in_chunk::value_type>(min.z);
+		std::size_t block_i = padded_chunk::index(x, y, min_z);
+		for(auto z = min_z; z < max.z; ++z, ++block_i)
 		{
-			const Face face = static_cast<Face>(face_i);
-			const Side side = to_side(face);
-			const auto i = get_i(face);
-			glm::tvec3<int8_t> pos(x, y, z);
-			pos[i.y] += static_cast<int8_t>(side);
+			const block::base& block = blocks.get(block_i);
+			if(block.is_invisible())
+			{
+				continue;
+			}
 
-			bool is_visible;
-			if(pos.x >= 0 && pos.x < CHUNK_SIZE
-			&& pos.y >= 0 && pos.y < CHUNK_SIZE
-			&& pos.z >= 0 && pos.z < CHUNK_SIZE)
+			for(uint8_t face_i = 0; face_i < 6; ++face_i)
 			{
-				const std::size_t sibling_i = static_cast<std::size_t>(CHUNK_SIZE * CHUNK_SIZE * pos.x + CHUNK_SIZE * pos.y + pos.z);
-				const block::base& sibling = *cache[sibling_i];
-				is_visible =
+				const Face face = static_cast<Face>(face_i);
+				const block::base& sibling = blocks.get(static_cast<std::size_t>(static_cast<std::ptrdiff_t>(block_i) + sibling_offset[face_i]));
+				const bool is_visible =
 					   sibling.type() != block::enums::type::none
-					&& !block.is_invisible() // this block is visible
 					&& !sibling.is_opaque() // this block can be seen thru the adjacent block
 					&& block.type() != sibling.type() // do not show sides inside of adjacent translucent blocks (of the same type)
 				;
-			}
-			else
-			{
-				is_visible = block_visible_from(chunk, block, pos.x, pos.y, pos.z);
-			}
-			if(is_visible)
-			{
-				const auto tex = game::instance->resource_manager.get_block_texture(block.texture(face));
-				const meshmap_key_t key =
+				if(is_visible)
 				{
-					block.shader(face),
-					block.is_translucent(),
-					tex.unit,
-				};
-				Base::add_face(meshes[key], {x, y, z}, face, 1, 1, tex.index, block.rotation(face));
+					const face_traits_t& traits = render_traits->get(block, face);
+					Base::add_face(meshes[traits.key], {x, y, z}, face, 1, 1, traits.tex_index, traits.rotation);
+				}
 			}
 		}
 	}
@@ -0,0 +1,110 @@
+#include "padded_chunk.hpp"
+
+#include <cassert>
+#include <utility>
+
+#include <glm/vec3.hpp>
+
+#include "block/base.hpp"
+#include "block/BlockRegistry.hpp"
+#include "block/enums/Face.hpp"
+#include "block/enums/type.hpp"
+#include "chunk/Chunk.hpp"
+#include "position/block_in_chunk.hpp"
+#include "world/world.hpp"
+
+namespace block_thingy::mesher {
+
+using std::shared_ptr;
+
+using block::enums::Face;
+using position::block_in_chunk;
+
+padded_chunk::padded_chunk(const Chunk& chunk)
+:
+	padded_chunk(chunk.get_owner().block_registry.get_default(block::enums::type::none))
+{
+	const chunk_blocks_t::snapshot center = chunk.copy_blocks();
+	owned.insert(owned.end(), center.palette.cbegin(), center.palette.cend());
+	std::size_t block_i = 0;
+	for(int_fast16_t x = 0; x < CHUNK_SIZE; ++x)
+	for(int_fast16_t y = 0; y < CHUNK_SIZE; ++y)
+	for(int_fast16_t z = 0; z < CHUNK_SIZE; ++z, ++block_i)
+	{
+		blocks[index(x, y, z)] = center[block_i].get();
+	}
+
+	// only the face neighbours are needed, so the edges and corners of the border stay as none
+	for(uint8_t face_i = 0; face_i < 6; ++face_i)
+	{
+		const glm::ivec3 vec = block::enums::face_to_vec(static_cast<Face>(face_i));
+		const shared_ptr<Chunk> neighbor = chunk.get_neighbor(vec);
+		if(neighbor == nullptr)
+		{
+			continue;
+		}
+
+		const int axis = (vec.x != 0) ? 0 : (vec.y != 0) ? 1 : 2;
+		const bool positive = vec[axis] > 0;
+		// the layer of the neighbour that touches this chunk, copied at once
+		constexpr auto last = static_cast<block_in_chunk::value_type>(CHUNK_SIZE - 1);
+		block_in_chunk min(0, 0, 0);
+		block_in_chunk max(last, last, last);
+		min[axis] = max[axis] = positive ? 0 : last;
+		const chunk_blocks_t::snapshot layer = neighbor->copy_blocks(min, max);
+		owned.insert(owned.end(), layer.palette.cbegin(), layer.palette.cend());
+
+		const int_fast16_t to = positive ? CHUNK_SIZE : -1;
+		std::size_t layer_i = 0;
+		glm::tvec3<int_fast16_t> pos;
+		for(pos.x = min.x; pos.x <= max.x; ++pos.x)
+		for(pos.y = min.y; pos.y <= max.y; ++pos.y)
+		for(pos.z = min.z; pos.z <= max.z; ++pos.z, ++layer_i)
+		{
+			glm::tvec3<int_fast16_t> pos2 = pos;
+			pos2[axis] = to;
+			blocks[index(pos2.x, pos2.y, pos2.z)] = layer[layer_i].get();
+		}
+	}
+}
+
+padded_chunk::padded_chunk(shared_ptr<block::base> fill)
+:
+	blocks(static_cast<std::size_t>(SIZE * SIZE * SIZE), fill.get()),
+	mesh_min_(0),
+	mesh_max_(CHUNK_SIZE)
+{
+	owned.emplace_back(std::move(fill));
+}
+
+void padded_chunk::set
+(
+	const int_fast16_t x,
+	const int_fast16_t y,
+	const int_fast16_t z,
+	shared_ptr<block::base> block
+)
+{
+	blocks[index(x, y, z)] = block.get();
+	// neighbouring blocks are usually the same instance, so this stays small
+	if(owned.back() != block)
+	{
+		owned.emplace_back(std::move(block));
+	}
+}
+
+void padded_chunk::set_mesh_bounds
+(
+	const glm::tvec3<int_fast16_t>& min,
+	const glm::tvec3<int_fast16_t>& max
+)
+{
+	for(int i = 0; i < 3; ++i)
+	{
+		assert(0 <= min[i] && min[i] <= max[i] && max[i] <= CHUNK_SIZE);
+	}
+	mesh_min_ = min;
+	mesh_max_ = max;
+}
+
+}
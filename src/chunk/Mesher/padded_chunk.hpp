@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "fwd/block/base.hpp"
+#include "fwd/chunk/Chunk.hpp"
+
+namespace block_thingy::mesher {
+
+/**
+ * The blocks of a chunk plus a one block border taken from its 6 face neighbours, in one flat array.
+ * Meshers read only from this, so meshing does not look anything up in the world.
+ */
+class padded_chunk
+{
+public:
+	static constexpr int_fast32_t SIZE = CHUNK_SIZE + 2;
+
+	/**
+	 * Gather the blocks of the chunk and its border from the chunk's world
+	 */
+	explicit padded_chunk(const Chunk&);
+
+	/**
+	 * Make a padded chunk where every block (including the border) is `fill`, to be filled with `set`
+	 */
+	explicit padded_chunk(std::shared_ptr<block::base> fill);
+
+	padded_chunk(padded_chunk&&) = default;
+	padded_chunk(const padded_chunk&) = delete;
+	padded_chunk& operator=(padded_chunk&&) = default;
+	padded_chunk& operator=(const padded_chunk&) = delete;
+
+	/**
+	 * The coordinates are relative to the chunk and range from -1 to CHUNK_SIZE
+	 */
+	const block::base& get(int_fast16_t x, int_fast16_t y, int_fast16_t z) const
+	{
+		return *blocks[index(x, y, z)];
+	}
+
+	/**
+	 * @param i An index from `index`
+	 */
+	const block::base& get(const std::size_t i) const
+	{
+		return *blocks[i];
+	}
+
+	void set(int_fast16_t x, int_fast16_t y, int_fast16_t z, std::shared_ptr<block::base>);
+
+	/**
+	 * Meshers only make faces for the blocks from `min` to `max` (exclusive), so that a chunk can be meshed a section at a time.
+	 * The default is the whole chunk.
+	 */
+	void set_mesh_bounds(const glm::tvec3<int_fast16_t>& min, const glm::tvec3<int_fast16_t>& max);
+	const glm::tvec3<int_fast16_t>& mesh_min() const
+	{
+		return mesh_min_;
+	}
+	const glm::tvec3<int_fast16_t>& mesh_max() const
+	{
+		return mesh_max_;
+	}
+
+	// x major, z minor, so a step of 1 on each axis is SIZE * SIZE, SIZE, and 1
+	static std::size_t index(const int_fast16_t x, const int_fast16_t y, const int_fast16_t z)
+	{
+		return static_cast<std::size_t>(SIZE * SIZE * (x + 1) + SIZE * (y + 1) + (z + 1));
+	}
+
+private:
+	// keeps the blocks in `blocks` alive while meshing, even if the world replaces them
+	std::vector<std::shared_ptr<block::base>> owned;
+	std::vector<const block::base*> blocks;
+
+	glm::tvec3<int_fast16_t> mesh_min_;
+	glm::tvec3<int_fast16_t> mesh_max_;
+};
+
+}
@@ -0,0 +1,93 @@
+#include "render_traits.hpp"
+
+#include "game.hpp"
+#include "resource_manager.hpp"
+#include "block/base.hpp"
+#include "block/BlockRegistry.hpp"
+#include "block/rotation_util.hpp"
+#include "block/enums/Face.hpp"
+#include "block/enums/type.hpp"
+
+namespace block_thingy::mesher {
+
+using block::enums::Face;
+
+// each rotation axis is 0 to 3 quarter turns
+constexpr std::size_t rotation_count = 4 * 4 * 4;
+
+render_traits::render_traits()
+:
+	type_count(0)
+{
+}
+
+render_traits::render_traits
+(
+	const block::BlockRegistry& block_registry,
+	resource_manager& resource_manager
+)
+:
+	type_count(block_registry.get_max_id()),
+	traits(type_count * rotation_count * 6)
+{
+	for(std::size_t t = 0; t < type_count; ++t)
+	{
+		const auto block = block_registry.get_default(static_cast<block::enums::type>(t));
+		// the LUT has every rotation that a block can have
+		for(const auto& p : block::rotation_util::face_rotation_LUT)
+		{
+			for(uint8_t face_i = 0; face_i < 6; ++face_i)
+			{
+				const Face face = static_cast<Face>(face_i);
+				traits[index(t, p.first, face)] = make(*block, p.first, face, resource_manager);
+			}
+		}
+	}
+}
+
+const face_traits_t& render_traits::get(const block::base& block, const Face face) const
+{
+	const auto t = static_cast<std::size_t>(block.type());
+	if(t < type_count)
+	{
+		return traits[index(t, block.rotation(), face)];
+	}
+
+	thread_local face_traits_t fallback;
+	fallback = make(block, block.rotation(), face, game::instance->resource_manager);
+	return fallback;
+}
+
+face_traits_t render_traits::make
+(
+	const block::base& block,
+	const glm::tvec3<uint8_t>& rotation,
+	const Face face,
+	resource_manager& resource_manager
+)
+{
+	const auto tex = resource_manager.get_block_texture(block.texture(face, rotation));
+	return
+	{
+		{
+			resource_manager.get_material_id(block.shader(face, rotation)),
+			block.is_translucent(),
+			tex.unit,
+		},
+		tex.index,
+		block::rotation_util::face_rotation_LUT.at(rotation).at(face),
+	};
+}
+
+std::size_t render_traits::index
+(
+	const std::size_t type,
+	const glm::tvec3<uint8_t>& rotation,
+	const Face face
+)
+{
+	const std::size_t r = rotation.x + 4u * rotation.y + 16u * rotation.z;
+	return (type * rotation_count + r) * 6 + static_cast<std::size_t>(face);
+}
+
+}
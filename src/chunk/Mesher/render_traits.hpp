@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "fwd/block/base.hpp"
+#include "fwd/block/BlockRegistry.hpp"
+#include "fwd/block/enums/Face.hpp"
+#include "chunk/Mesher/Base.hpp"
+#include "fwd/resource_manager.hpp"
+
+namespace block_thingy::mesher {
+
+/**
+ * How one face of a block is drawn
+ */
+struct face_traits_t
+{
+	meshmap_key_t key;
+	uint16_t tex_index;
+	uint8_t rotation;
+
+	bool operator==(const face_traits_t& that) const
+	{
+		return
+			key == that.key
+		 && tex_index == that.tex_index
+		 && rotation == that.rotation;
+	}
+};
+
+/**
+ * The face traits of every block type in every rotation, so that meshers do not resolve shaders and textures per face.
+ * This is immutable; resource_manager makes a new one when blocks or textures change.
+ */
+class render_traits
+{
+public:
+	render_traits();
+	render_traits(const block::BlockRegistry&, resource_manager&);
+
+	/**
+	 * The returned reference is valid until the next call on the same thread
+	 * when the block type was added after this table was made.
+	 */
+	const face_traits_t& get(const block::base&, block::enums::Face) const;
+
+	static face_traits_t make(const block::base&, const glm::tvec3<uint8_t>& rotation, block::enums::Face, resource_manager&);
+
+private:
+	static std::size_t index(std::size_t type, const glm::tvec3<uint8_t>& rotation, block::enums::Face);
+
+	std::size_t type_count;
+	std::vector<face_traits_t> traits;
+};
+
+}
@@ -8,5 +8,10 @@ namespace block_thingy
 	constexpr int_fast32_t CHUNK_SIZE = 32;
 	constexpr int_fast32_t CHUNK_BLOCK_COUNT = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
 
+	// chunks are meshed in sections, so that changing a block only remakes the sections it changes
+	constexpr int_fast32_t CHUNK_SECTION_SIZE = CHUNK_SIZE / 2;
+	constexpr int_fast32_t CHUNK_SECTIONS_PER_AXIS = CHUNK_SIZE / CHUNK_SECTION_SIZE;
+	constexpr int_fast32_t CHUNK_SECTION_COUNT = CHUNK_SECTIONS_PER_AXIS * CHUNK_SECTIONS_PER_AXIS * CHUNK_SECTIONS_PER_AXIS;
+
 	class Chunk;
 }
@@ -1,4 +1,8 @@
+#include <stdint.h>
+
 namespace block_thingy::mesher
 {
 	class Base;
+
+	using material_id_t = uint16_t;
 }
@@ -0,0 +1,6 @@
+#pragma once
+
+namespace block_thingy::mesher
+{
+	class padded_chunk;
+}
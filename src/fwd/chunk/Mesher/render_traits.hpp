@@ -0,0 +1,7 @@
+#pragma once
+
+namespace block_thingy::mesher
+{
+	class render_traits;
+	struct face_traits_t;
+}
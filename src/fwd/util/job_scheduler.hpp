@@ -0,0 +1,4 @@
+namespace block_thingy::util
+{
+	class job_scheduler;
+}
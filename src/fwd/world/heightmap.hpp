@@ -0,0 +1,4 @@
+namespace block_thingy::world
+{
+	class heightmap;
+}
@@ -1,13 +1,17 @@
 #include "game.hpp"
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -25,7 +29,11 @@
 #include "settings.hpp"
 #include "block/base.hpp"
 #include "block/enums/type.hpp"
+#include "chunk/Chunk.hpp"
+#include "chunk/Mesher/Base.hpp"
+#include "chunk/Mesher/Binary.hpp"
 #include "chunk/Mesher/Greedy.hpp"
+#include "chunk/Mesher/padded_chunk.hpp"
 #include "chunk/Mesher/Simple.hpp"
 #include "chunk/Mesher/Simple2.hpp"
 #include "console/Command.hpp"
@@ -48,10 +56,13 @@
 #include "position/block_in_chunk.hpp"
 #include "position/block_in_world.hpp"
 #include "position/chunk_in_world.hpp"
+#include "position/hash.hpp"
+#include "util/concurrent_map.hpp"
 #include "util/filesystem.hpp"
 #include "util/key_press.hpp"
 #include "util/logger.hpp"
 #include "util/misc.hpp"
+#include "util/ThreadThingy.hpp"
 
 using std::nullopt;
 using std::shared_ptr;
@@ -69,6 +80,7 @@ struct game::impl
 		g(g),
 		delta_time(0),
 		fps(999),
+		chunk_view(g.world),
 		just_opened_gui(false),
 		last_key(0),
 		last_key_scancode(0),
@@ -82,6 +94,7 @@ struct game::impl
 	double delta_time;
 	fps_manager fps;
 	std::tuple<uint64_t, uint64_t> draw_stats;
+	graphics::chunk_view chunk_view;
 
 	void find_hovered_block();
 
@@ -100,7 +113,11 @@ struct game::impl
 static unique_ptr<mesher::Base> make_mesher(const string& name)
 {
 	unique_ptr<mesher::Base> mesher;
-	if(name == "Greedy")
+	if(name == "Binary")
+	{
+		return std::make_unique<mesher::Binary>();
+	}
+	else if(name == "Greedy")
 	{
 		return std::make_unique<mesher::Greedy>();
 	}
@@ -119,7 +136,7 @@ static unique_ptr<mesher::Base> make_mesher(const string& name)
 game::game()
 :
 	set_instance(this),
-	world("worlds/test", block_registry, make_mesher(settings::get<string>("mesher"))),
+	world("worlds/test", block_registry, make_mesher(settings::get<string>("mesher")), job_scheduler),
 	player_ptr(world.add_player("test_player")),
 	player(*player_ptr),
 	keybinder(*Console::instance),
@@ -182,6 +199,8 @@ game::game()
 	});
 
 	PluginManager::instance->init_plugins(*this);
+	// plugins can add blocks
+	resource_manager.update_render_traits(block_registry);
 
 	copied_block = block_registry.get_default("light");
 }
@@ -331,6 +350,7 @@ void game::draw_world
 	position::block_in_world render_origin(cam_position);
 	const std::tuple<uint64_t, uint64_t> draw_stats = graphics::draw_world
 	(
+		pImpl->chunk_view,
 		world,
 		resource_manager,
 		gfx.vp_matrix,
@@ -748,6 +768,220 @@ void game::impl::add_commands()
 		LOG(INFO) << "reach distance: " << player.reach_distance << '\n';
 	});
 
+	COMMAND("bench.material_lookup")
+	{
+		if(args.size() > 1 || (args.size() == 1 && !util::is_integer(args[0])))
+		{
+			LOG(ERROR) << "Usage: bench.material_lookup [int: lookups]\n";
+			return;
+		}
+		const long long count = args.empty() ? 1000000 : util::stoll(args[0]);
+
+		// how Chunk::render found the shader program of a mesh before material IDs, and how it does now
+		const fs::path path = "shaders/block/default";
+		const mesher::material_id_t id = g.resource_manager.get_material_id(path);
+
+		using clock = std::chrono::steady_clock;
+		const auto start_path = clock::now();
+		for(long long i = 0; i < count; ++i)
+		{
+			g.resource_manager.get_shader_program(path);
+		}
+		const auto start_id = clock::now();
+		for(long long i = 0; i < count; ++i)
+		{
+			g.resource_manager.get_material_program(id);
+		}
+		const auto end = clock::now();
+
+		const auto ns = [count](const clock::duration d)
+		{
+			return std::chrono::duration<double, std::nano>(d).count() / static_cast<double>(count);
+		};
+		LOG(INFO) << "shader program lookup (" << count << " times): "
+				  << ns(start_id - start_path) << " ns by path, "
+				  << ns(end - start_id) << " ns by material ID\n";
+	});
+
+	COMMAND("bench.mesh_size")
+	{
+		if(!args.empty())
+		{
+			LOG(ERROR) << "Usage: bench.mesh_size\n";
+			return;
+		}
+
+		// mesh the loaded chunks in render distance and compare the CPU-side size of each mesh_format
+		const position::chunk_in_world center(position::block_in_world(g.camera.position));
+		const auto render_distance = static_cast<position::chunk_in_world::value_type>(settings::get<int64_t>("render_distance"));
+		std::size_t chunk_count = 0;
+		std::size_t quad_count = 0;
+		for(auto x = -render_distance; x <= render_distance; ++x)
+		for(auto y = -render_distance; y <= render_distance; ++y)
+		for(auto z = -render_distance; z <= render_distance; ++z)
+		{
+			const shared_ptr<Chunk> chunk = g.world.get_chunk(center + position::chunk_in_world(x, y, z));
+			if(chunk == nullptr || chunk->is_invisible())
+			{
+				continue;
+			}
+			++chunk_count;
+			for(const auto& p : g.world.mesher->make_mesh(mesher::padded_chunk(*chunk)))
+			{
+				quad_count += p.second.size();
+			}
+		}
+
+		const std::size_t triangles_size = quad_count * mesher::quad_indices.size() * sizeof(mesher::mesh_vertex_t);
+		const std::size_t quads_size = quad_count * sizeof(mesher::mesh_quad_t);
+		const std::size_t packed_size = quad_count * 4 * sizeof(mesher::mesh_packed_vertex_t);
+		LOG(INFO) << chunk_count << " chunks, " << quad_count << " faces: "
+				  << triangles_size << " bytes as triangles, "
+				  << quads_size << " bytes as quads, "
+				  << packed_size << " bytes packed\n";
+	});
+
+	COMMAND("bench.jobs")
+	{
+		if(args.size() > 1 || (args.size() == 1 && !util::is_integer(args[0])))
+		{
+			LOG(ERROR) << "Usage: bench.jobs [int: jobs]\n";
+			return;
+		}
+		const long long count = args.empty() ? 10000 : util::stoll(args[0]);
+
+		// the same setup as the world's stages: the shared scheduler, and each job dequeues itself
+		using clock = std::chrono::steady_clock;
+		auto run = [&g, count](const std::function<void()>& work) -> double
+		{
+			std::atomic<long long> done(0);
+			util::ThreadThingy<long long>* jobs_ptr = nullptr;
+			util::ThreadThingy<long long> jobs([&work, &done, &jobs_ptr](long long& i)
+			{
+				work();
+				jobs_ptr->dequeue(i);
+				++done;
+			}, g.job_scheduler, 0);
+			jobs_ptr = &jobs;
+
+			const auto start = clock::now();
+			for(long long i = 0; i < count; ++i)
+			{
+				jobs.enqueue(i);
+			}
+			while(done < count)
+			{
+				std::this_thread::yield();
+			}
+			const std::chrono::duration<double> time = clock::now() - start;
+			return static_cast<double>(count) / time.count();
+		};
+
+		LOG(INFO) << "empty job: " << run([]() {}) << " jobs/s\n";
+
+		const shared_ptr<Chunk> chunk = g.world.get_chunk(position::chunk_in_world(position::block_in_world(g.camera.position)));
+		if(chunk == nullptr)
+		{
+			LOG(WARN) << "the chunk at the camera is not loaded, so there is no mesh job\n";
+			return;
+		}
+		LOG(INFO) << "mesh job: " << run([&g, &chunk]()
+		{
+			g.world.mesher->make_mesh(mesher::padded_chunk(*chunk));
+		}) << " chunks/s\n";
+	});
+
+	COMMAND("bench.chunk_map")
+	{
+		if(args.size() > 1 || (args.size() == 1 && !util::is_integer(args[0])))
+		{
+			LOG(ERROR) << "Usage: bench.chunk_map [int: reader threads]\n";
+			return;
+		}
+		const long long reader_count = args.empty() ? static_cast<long long>(util::job_scheduler::default_thread_count()) : util::stoll(args[0]);
+
+		// readers look up chunks while one writer replaces them, like meshers reading neighbors while the main thread adds chunks
+		// how the world's chunks were stored (one mutex around an unordered_map), and how they are now
+		using key_t = position::chunk_in_world;
+		using value_t = shared_ptr<int>;
+		// 34³ (about 40000) keys, as many as a render distance of 16 has, so that the tables are as big as they get in play
+		std::vector<key_t> keys;
+		for(position::chunk_in_world::value_type x = -17; x < 17; ++x)
+		for(position::chunk_in_world::value_type y = -17; y < 17; ++y)
+		for(position::chunk_in_world::value_type z = -17; z < 17; ++z)
+		{
+			keys.emplace_back(x, y, z);
+		}
+
+		using clock = std::chrono::steady_clock;
+		auto run = [&keys, reader_count](const auto& get, const auto& set) -> std::pair<double, double>
+		{
+			for(const key_t& key : keys)
+			{
+				set(key, std::make_shared<int>(0));
+			}
+
+			std::atomic<bool> stop(false);
+			std::atomic<uint64_t> reads(0);
+			std::vector<std::thread> readers;
+			for(long long t = 0; t < reader_count; ++t)
+			{
+				readers.emplace_back([&keys, &get, &stop, &reads, t]()
+				{
+					uint64_t found = 0;
+					std::size_t i = static_cast<std::size_t>(t) * 997;
+					while(!stop.load(std::memory_order_relaxed))
+					{
+						i = (i + 997) % keys.size();
+						found += (get(keys[i]) != nullptr) ? 1 : 0;
+					}
+					reads += found;
+				});
+			}
+
+			uint64_t writes = 0;
+			const auto start = clock::now();
+			while(clock::now() - start < std::chrono::seconds(1))
+			{
+				set(keys[(writes * 31) % keys.size()], std::make_shared<int>(0));
+				++writes;
+			}
+			stop = true;
+			for(std::thread& t : readers)
+			{
+				t.join();
+			}
+			const std::chrono::duration<double> time = clock::now() - start;
+			return {static_cast<double>(reads) / time.count(), static_cast<double>(writes) / time.count()};
+		};
+
+		position::unordered_map_t<key_t, value_t> locked_map;
+		std::mutex locked_map_mutex;
+		const std::pair<double, double> locked = run([&locked_map, &locked_map_mutex](const key_t& key) -> value_t
+		{
+			std::lock_guard<std::mutex> g(locked_map_mutex);
+			const auto i = locked_map.find(key);
+			return (i == locked_map.cend()) ? nullptr : i->second;
+		}, [&locked_map, &locked_map_mutex](const key_t& key, value_t value)
+		{
+			std::lock_guard<std::mutex> g(locked_map_mutex);
+			locked_map.insert_or_assign(key, std::move(value));
+		});
+
+		util::concurrent_map<key_t, value_t, position::hasher_struct<key_t>> concurrent_map;
+		const std::pair<double, double> concurrent = run([&concurrent_map](const key_t& key)
+		{
+			return concurrent_map.get(key);
+		}, [&concurrent_map](const key_t& key, value_t value)
+		{
+			concurrent_map.set(key, std::move(value));
+		});
+
+		LOG(INFO) << reader_count << " readers and 1 writer:\n"
+				  << "mutex map: " << locked.first << " lookups/s, " << locked.second << " writes/s\n"
+				  << "concurrent map: " << concurrent.first << " lookups/s, " << concurrent.second << " writes/s\n";
+	});
+
 	COMMAND("nazi")
 	{
 		if(g.hovered_block == nullopt || g.copied_block == nullptr)
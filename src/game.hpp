@@ -23,6 +23,7 @@
 #include "types/window_size_t.hpp"
 #include "fwd/util/char_press.hpp"
 #include "util/filesystem.hpp"
+#include "util/job_scheduler.hpp"
 #include "fwd/util/key_press.hpp"
 #include "fwd/util/mouse_press.hpp"
 #include "world/world.hpp"
@@ -56,6 +57,10 @@ public:
 	void draw();
 	void step_world();
 	void draw_world();
+	/**
+	 * The chunks to draw are kept between frames for one origin, so drawing from another origin
+	 * (such as a second camera every frame) makes them be looked up again each time the origin changes
+	 */
 	void draw_world
 	(
 		const glm::dvec3& cam_position,
@@ -98,6 +103,8 @@ public:
 	Gfx gfx;
 
 	camera camera;
+	// the threads for background work (such as meshing); plugins can submit jobs here
+	util::job_scheduler job_scheduler; // must be initialized before world
 	block::BlockRegistry block_registry; // must be initialized before world
 	world::world world;
 	std::shared_ptr<Player> player_ptr;
@@ -180,6 +180,7 @@ void Play::draw_debug_text()
 		ss << "\trotation: " << glm::io::width(2) << hovered->rotation() << '\n';
 		ss << "\temitted light: " << hovered->light() << '\n';
 		ss << "\tlight: " << g.world.get_blocklight(g.hovered_block->adjacent()) << '\n';
+		ss << "\tsky light: " << static_cast<int>(g.world.get_skylight(g.hovered_block->adjacent())) << '\n';
 	}
 
 	g.gfx.gui_text.draw(ss.str(), {8.0, 8.0});
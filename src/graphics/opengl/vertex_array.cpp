@@ -4,7 +4,7 @@
 
 namespace block_thingy::graphics::opengl {
 
-vertex_array::vertex_array(const vertex_buffer& vbo)
+vertex_array::vertex_array(const vertex_buffer& vbo, const GLuint first_attrib)
 {
 	glCreateVertexArrays(1, &name);
 	inited = true;
@@ -21,19 +21,33 @@ vertex_array::vertex_array(const vertex_buffer& vbo)
 		}
 	}
 
-	GLuint i = 0;
+	GLuint i = first_attrib;
 	GLsizeiptr offset = 0;
 	for(const auto& format : vbo.formats)
 	{
-		glVertexAttribPointer
-		(
-			i,
-			format.size,
-			format.type,
-			format.normalized,
-			stride,
-			reinterpret_cast<GLvoid*>(offset)
-		);
+		if(format.integer)
+		{
+			glVertexAttribIPointer
+			(
+				i,
+				format.size,
+				format.type,
+				stride,
+				reinterpret_cast<GLvoid*>(offset)
+			);
+		}
+		else
+		{
+			glVertexAttribPointer
+			(
+				i,
+				format.size,
+				format.type,
+				format.normalized,
+				stride,
+				reinterpret_cast<GLvoid*>(offset)
+			);
+		}
 		attrib(i, true);
 		++i;
 		offset += format.byte_size;
@@ -76,10 +90,21 @@ void vertex_array::attrib(const GLuint index, const bool enabled)
 	}
 }
 
+void vertex_array::element_buffer(const vertex_buffer& ebo)
+{
+	glVertexArrayElementBuffer(name, ebo.name);
+}
+
 void vertex_array::draw(const GLenum mode, const GLint first, const std::size_t count) const
 {
 	glBindVertexArray(name);
 	glDrawArrays(mode, first, count);
 }
 
+void vertex_array::draw_elements(const GLenum mode, const std::size_t count) const
+{
+	glBindVertexArray(name);
+	glDrawElements(mode, static_cast<GLsizei>(count), GL_UNSIGNED_INT, nullptr);
+}
+
 }
@@ -12,7 +12,7 @@ class vertex_array
 {
 public:
 	// TODO: allow multiple buffers
-	vertex_array(const vertex_buffer&);
+	vertex_array(const vertex_buffer&, GLuint first_attrib = 0);
 	~vertex_array();
 
 	vertex_array(vertex_array&&);
@@ -24,7 +24,11 @@ public:
 
 	void attrib(GLuint index, bool enabled);
 
+	// the buffer holds GL_UNSIGNED_INT indices for draw_elements
+	void element_buffer(const vertex_buffer&);
+
 	void draw(GLenum mode, GLint first, std::size_t count) const;
+	void draw_elements(GLenum mode, std::size_t count) const;
 
 private:
 	bool inited;
@@ -42,6 +42,7 @@ public:
 		GLenum type;
 		bool normalized = false;
 		GLsizei byte_size = 0;
+		bool integer = false; // read as int/uint in shaders instead of being converted to float
 	};
 
 private:
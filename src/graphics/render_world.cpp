@@ -1,7 +1,11 @@
 #include "render_world.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <glm/trigonometric.hpp>
 
@@ -28,8 +32,244 @@ using graphics::opengl::shader_program;
 using position::block_in_world;
 using position::chunk_in_world;
 
+// ask for a missing chunk again after this many frames, in case its job was cancelled
+constexpr uint64_t request_interval = 60;
+// missing positions checked each frame, so that the whole range is not checked every frame
+constexpr std::size_t missing_checks_per_frame = 4096;
+
+static chunk_in_world::value_type distance_squared(const chunk_in_world& d)
+{
+	return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+chunk_view::chunk_view(world::world& world)
+:
+	world(world),
+	render_distance(-1),
+	removed(false),
+	missing_cursor(0),
+	frame(0)
+{
+	listener_id = world.add_chunk_listener([this](const chunk_in_world& position, const shared_ptr<Chunk>& chunk)
+	{
+		chunk_changed(position, chunk);
+	});
+}
+
+chunk_view::~chunk_view()
+{
+	world.remove_chunk_listener(listener_id);
+}
+
+void chunk_view::begin(const chunk_in_world& center, const chunk_in_world::value_type render_distance)
+{
+	frame += 1;
+	if(render_distance != this->render_distance)
+	{
+		this->center = center;
+		set_render_distance(render_distance);
+		return;
+	}
+
+	if(removed)
+	{
+		removed = false;
+		auto lost_chunk = [this](const chunk_in_world& position)
+		{
+			cell& c = cells[cell_index(position)];
+			if(c.chunk != nullptr)
+			{
+				return false;
+			}
+			c.listed = false;
+			return true;
+		};
+		present.erase(std::remove_if(present.begin(), present.end(), lost_chunk), present.end());
+		added.erase(std::remove_if(added.begin(), added.end(), lost_chunk), added.end());
+	}
+	const std::size_t sorted = present.size();
+	present.insert(present.end(), added.cbegin(), added.cend());
+	added.clear();
+	if(center != this->center)
+	{
+		move(center);
+		sort_present(0);
+	}
+	else if(present.size() != sorted)
+	{
+		sort_present(sorted);
+	}
+}
+
+void chunk_view::set_render_distance(const chunk_in_world::value_type render_distance)
+{
+	this->render_distance = render_distance;
+
+	offsets.clear();
+	chunk_in_world d;
+	for(d.x = -render_distance; d.x <= render_distance; ++d.x)
+	for(d.y = -render_distance; d.y <= render_distance; ++d.y)
+	for(d.z = -render_distance; d.z <= render_distance; ++d.z)
+	{
+		offsets.emplace_back(d);
+	}
+	std::sort(offsets.begin(), offsets.end(), [](const chunk_in_world& a, const chunk_in_world& b)
+	{
+		return distance_squared(a) < distance_squared(b);
+	});
+
+	const chunk_in_world::value_type size = render_distance * 2 + 1;
+	cells.assign(static_cast<std::size_t>(size * size * size), cell{chunk_in_world(0, 0, 0), nullptr, false, false, 0});
+	present.clear();
+	added.clear();
+	removed = false;
+	missing_cursor = 0;
+	// in order of distance, so present does not need sorting
+	for(const chunk_in_world& offset : offsets)
+	{
+		look_up(center + offset);
+	}
+}
+
+void chunk_view::move(const chunk_in_world& center)
+{
+	const chunk_in_world old_center = this->center;
+	this->center = center;
+	missing_cursor = 0;
+
+	// the cells of the positions that leave the range are reset by the positions that come into it
+	present.erase(std::remove_if(present.begin(), present.end(), [this](const chunk_in_world& position)
+	{
+		return !in_range(position);
+	}), present.end());
+
+	const chunk_in_world::value_type r = render_distance;
+	auto was_in_range = [r](const chunk_in_world::value_type v, const chunk_in_world::value_type old)
+	{
+		return v >= old - r && v <= old + r;
+	};
+	chunk_in_world p;
+	for(p.x = center.x - r; p.x <= center.x + r; ++p.x)
+	{
+		const bool x_new = !was_in_range(p.x, old_center.x);
+		for(p.y = center.y - r; p.y <= center.y + r; ++p.y)
+		{
+			const bool y_new = x_new || !was_in_range(p.y, old_center.y);
+			for(p.z = center.z - r; p.z <= center.z + r; ++p.z)
+			{
+				if(!y_new && was_in_range(p.z, old_center.z))
+				{
+					// skip the rest of the old range in this row
+					p.z = old_center.z + r;
+					continue;
+				}
+				look_up(p);
+			}
+		}
+	}
+}
+
+void chunk_view::look_up(const chunk_in_world& position)
+{
+	cell& c = cells[cell_index(position)];
+	c = {position, world.get_chunk(position), false, false, 0};
+	if(c.chunk != nullptr)
+	{
+		c.listed = true;
+		present.emplace_back(position);
+	}
+}
+
+void chunk_view::sort_present(const std::size_t sorted)
+{
+	const chunk_in_world& center = this->center;
+	auto nearer = [&center](const chunk_in_world& a, const chunk_in_world& b)
+	{
+		return distance_squared(a - center) < distance_squared(b - center);
+	};
+	std::sort(present.begin() + static_cast<std::ptrdiff_t>(sorted), present.end(), nearer);
+	std::inplace_merge(present.begin(), present.begin() + static_cast<std::ptrdiff_t>(sorted), present.end(), nearer);
+}
+
+void chunk_view::chunk_changed(const chunk_in_world& position, const shared_ptr<Chunk>& chunk)
+{
+	// positions that come into range later are looked up then
+	if(cells.empty() || !in_range(position))
+	{
+		return;
+	}
+	cell& c = cells[cell_index(position)];
+	c.chunk = chunk;
+	if(chunk == nullptr)
+	{
+		removed = true;
+	}
+	else if(!c.listed)
+	{
+		c.listed = true;
+		added.emplace_back(position);
+	}
+}
+
+const shared_ptr<Chunk>& chunk_view::get_chunk(const chunk_in_world& position) const
+{
+	static const shared_ptr<Chunk> none;
+	if(cells.empty() || !in_range(position))
+	{
+		return none;
+	}
+	return cells[cell_index(position)].chunk;
+}
+
+const std::vector<chunk_in_world>& chunk_view::next_missing(std::size_t count)
+{
+	missing.clear();
+	count = std::min(count, offsets.size());
+	for(std::size_t n = 0; n < count; ++n)
+	{
+		const chunk_in_world position = center + offsets[missing_cursor];
+		missing_cursor = (missing_cursor + 1) % offsets.size();
+		if(cells[cell_index(position)].chunk == nullptr)
+		{
+			missing.emplace_back(position);
+		}
+	}
+	return missing;
+}
+
+bool chunk_view::should_request(const chunk_in_world& position)
+{
+	cell& c = cells[cell_index(position)];
+	if(c.requested && frame - c.requested_frame < request_interval)
+	{
+		return false;
+	}
+	c.requested = true;
+	c.requested_frame = frame;
+	return true;
+}
+
+std::size_t chunk_view::cell_index(const chunk_in_world& position) const
+{
+	const chunk_in_world::value_type size = render_distance * 2 + 1;
+	auto wrap = [size](const chunk_in_world::value_type v)
+	{
+		return ((v % size) + size) % size;
+	};
+	return static_cast<std::size_t>((wrap(position.x) * size + wrap(position.y)) * size + wrap(position.z));
+}
+
+bool chunk_view::in_range(const chunk_in_world& position) const
+{
+	const chunk_in_world d = position - center;
+	return std::abs(d.x) <= render_distance
+		&& std::abs(d.y) <= render_distance
+		&& std::abs(d.z) <= render_distance;
+}
+
 std::tuple<uint64_t, uint64_t> draw_world
 (
+	chunk_view& view,
 	world::world& world,
 	resource_manager& resource_manager,
 	const glm::dmat4& vp_matrix_,
@@ -54,7 +294,7 @@ std::tuple<uint64_t, uint64_t> draw_world
 		}
 	});
 
-	std::unique_ptr<frustum> frustum_;
+	std::shared_ptr<frustum> frustum_;
 	if(settings::get<bool>("frustum_culling"))
 	{
 		const string projection_type = settings::get<string>("projection_type");
@@ -66,11 +306,11 @@ std::tuple<uint64_t, uint64_t> draw_world
 		const double ratio = static_cast<double>(Gfx::instance->window_size.x) / Gfx::instance->window_size.y;
 		if(projection_type == "default")
 		{
-			frustum_ = std::make_unique<default_view_frustum>(pos, rot, near, far, fov, ratio);
+			frustum_ = std::make_shared<default_view_frustum>(pos, rot, near, far, fov, ratio);
 		}
 		else if(projection_type == "infinite")
 		{
-			frustum_ = std::make_unique<default_view_frustum>(pos, rot, near, fov, ratio);
+			frustum_ = std::make_shared<default_view_frustum>(pos, rot, near, fov, ratio);
 		}
 		else if(projection_type == "ortho")
 		{
@@ -81,67 +321,81 @@ std::tuple<uint64_t, uint64_t> draw_world
 	}
 	if(frustum_ == nullptr)
 	{
-		frustum_ = std::make_unique<null_frustum<true>>();
+		frustum_ = std::make_shared<null_frustum<true>>();
 	}
 
+	// nearby chunks in view are generated, loaded, and meshed first
+	world.set_job_focus(camera_chunk, render_distance, frustum_);
+
 	const chunk_in_world chunk_pos(origin);
-	const chunk_in_world::value_type render_distance_ = static_cast<chunk_in_world::value_type>(render_distance);
-	const chunk_in_world min = chunk_pos - render_distance_;
-	const chunk_in_world max = chunk_pos + render_distance_;
+	view.begin(chunk_pos, static_cast<chunk_in_world::value_type>(render_distance));
+	auto in_view = [&frustum_, &camera_chunk](const chunk_in_world& pos)
+	{
+		const chunk_in_world gpos(pos - camera_chunk);
+		return frustum_->inside(physics::AABB(gpos));
+	};
 
 	const bool show_chunk_outlines = settings::get<bool>("show_chunk_outlines");
+	auto draw_outline = [](const chunk_in_world& pos, const glm::dvec4& color)
+	{
+		const glm::dvec3 min(static_cast<block_in_world::vec_type>(block_in_world(pos, {})));
+		const glm::dvec3 max(min + static_cast<double>(CHUNK_SIZE));
+		Gfx::instance->draw_box_outline(min, max, color);
+	};
 
-	std::vector<shared_ptr<Chunk>> drawn_chunks;
-
-	chunk_in_world pos;
-	for(pos.x = min.x; pos.x <= max.x; ++pos.x)
-	for(pos.y = min.y; pos.y <= max.y; ++pos.y)
-	for(pos.z = min.z; pos.z <= max.z; ++pos.z)
+	// ask for the missing chunks in view, nearest first, a few each frame
+	for(const chunk_in_world& pos : view.next_missing(missing_checks_per_frame))
 	{
-		const chunk_in_world gpos(pos - camera_chunk);
-		const physics::AABB aabb(gpos);
-		if(!frustum_->inside(aabb))
+		if(in_view(pos) && view.should_request(pos))
 		{
-			continue;
+			world.get_or_make_chunk(pos);
 		}
-
-		shared_ptr<Chunk> chunk = world.get_or_make_chunk(pos);
-
-		if(show_chunk_outlines)
+	}
+	if(show_chunk_outlines)
+	{
+		// this checks every position in range, but only while debugging
+		for(const chunk_in_world& offset : view.get_offsets())
 		{
-			const glm::dvec3 min(static_cast<block_in_world::vec_type>(block_in_world(pos, {})));
-			const glm::dvec3 max(min + static_cast<double>(CHUNK_SIZE));
-			glm::dvec4 color(glm::uninitialize);
-			if(chunk == nullptr)
+			const chunk_in_world pos = chunk_pos + offset;
+			if(view.get_chunk(pos) == nullptr && in_view(pos))
 			{
+				// TODO: add generating or loading = orange
 				// not loaded = red
-				color = glm::dvec4(1, 0, 0, 1);
+				draw_outline(pos, glm::dvec4(1, 0, 0, 1));
 			}
-			// TODO: add generating or loading = orange
-			else if(world.is_meshing_queued(chunk))
-			{
-				// meshing = yellow
-				color = glm::dvec4(1, 1, 0, 1);
-			}
-			else
-			{
-				// loaded = green
-				color = glm::dvec4(0, 1, 0, 1);
-			}
-			Gfx::instance->draw_box_outline(min, max, color);
 		}
-		if(chunk != nullptr)
+	}
+
+	std::vector<Chunk*> drawn_chunks;
+
+	// nearest first, so that the opaque pass hides more of what is behind
+	for(const chunk_in_world& pos : view.get_present())
+	{
+		if(!in_view(pos))
 		{
-			// false = opaque pass. Only opaque blocks will be drawn.
-			chunk->render(false);
-			drawn_chunks.emplace_back(chunk);
+			continue;
 		}
+		const shared_ptr<Chunk>& chunk = view.get_chunk(pos);
+
+		if(show_chunk_outlines)
+		{
+			// meshing = yellow, loaded = green
+			const bool meshing = world.is_meshing_queued(chunk);
+			draw_outline(pos, meshing ? glm::dvec4(1, 1, 0, 1) : glm::dvec4(0, 1, 0, 1));
+		}
+
+		world.update_chunk_if_dirty(chunk);
+
+		// false = opaque pass. Only opaque blocks will be drawn.
+		chunk->render(false);
+		drawn_chunks.emplace_back(chunk.get());
 	}
 
-	for(auto& chunk : drawn_chunks)
+	// farthest first, so that translucent blocks are blended over what is behind them
+	for(auto i = drawn_chunks.rbegin(); i != drawn_chunks.rend(); ++i)
 	{
 		// true = translucent pass. Only blocks with transparency will be drawn.
-		chunk->render(true);
+		(*i)->render(true);
 	}
 
 	uint64_t total = render_distance * 2 + 1;
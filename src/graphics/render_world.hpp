@@ -1,20 +1,123 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
 #include <tuple>
+#include <vector>
 
 #include <glm/mat4x4.hpp>
 
 #include "fwd/resource_manager.hpp"
+#include "fwd/chunk/Chunk.hpp"
 #include "fwd/position/block_in_world.hpp"
+#include "position/chunk_in_world.hpp"
 #include "fwd/world/world.hpp"
 
 namespace block_thingy::graphics {
 
+/**
+ * The chunks in render distance, kept between frames so that drawing does not look them up again.
+ *
+ * The world tells the view when a chunk is put in or taken out. When the center goes into another chunk,
+ * only the positions that come into range are looked up, and the ones that leave it are dropped.
+ * Everything is looked up again only when the render distance changes.
+ *
+ * Each position in range has a cell in a grid that wraps around (by position modulo its size),
+ * which holds its chunk and what is known about requests for it. A cell is reset when another position comes into it.
+ *
+ * The view follows one center, so it should be used for one origin; another origin each frame makes it look up every position again.
+ */
+class chunk_view
+{
+public:
+	explicit chunk_view(world::world&);
+	~chunk_view();
+
+	chunk_view(chunk_view&&) = delete;
+	chunk_view(const chunk_view&) = delete;
+	chunk_view& operator=(chunk_view&&) = delete;
+	chunk_view& operator=(const chunk_view&) = delete;
+
+	/**
+	 * Start a frame
+	 */
+	void begin(const position::chunk_in_world& center, position::chunk_in_world::value_type render_distance);
+
+	/**
+	 * The offsets of every position in render distance, nearest first
+	 */
+	const std::vector<position::chunk_in_world>& get_offsets() const
+	{
+		return offsets;
+	}
+
+	/**
+	 * The positions that have a chunk, nearest first
+	 */
+	const std::vector<position::chunk_in_world>& get_present() const
+	{
+		return present;
+	}
+
+	/**
+	 * @return The chunk at a position in range, or nullptr if there is none
+	 */
+	const std::shared_ptr<Chunk>& get_chunk(const position::chunk_in_world&) const;
+
+	/**
+	 * Check the next `count` positions in range (nearest first, starting again from the nearest when the center moves)
+	 *
+	 * @return The checked positions that do not have a chunk
+	 */
+	const std::vector<position::chunk_in_world>& next_missing(std::size_t count);
+
+	/**
+	 * Whether to ask the world for a chunk that is not there yet, which also checks if it is saved.
+	 * This is `true` once for each position, and again after a while in case its job was cancelled.
+	 */
+	bool should_request(const position::chunk_in_world&);
+
+private:
+	struct cell
+	{
+		position::chunk_in_world position;
+		std::shared_ptr<Chunk> chunk;
+		bool listed; // in present or added
+		bool requested;
+		uint64_t requested_frame;
+	};
+	std::size_t cell_index(const position::chunk_in_world&) const;
+	bool in_range(const position::chunk_in_world&) const;
+
+	void chunk_changed(const position::chunk_in_world&, const std::shared_ptr<Chunk>&);
+	void set_render_distance(position::chunk_in_world::value_type);
+	void move(const position::chunk_in_world& center);
+	void look_up(const position::chunk_in_world&);
+	// present is sorted up to `sorted`
+	void sort_present(std::size_t sorted);
+
+	world::world& world;
+	uint64_t listener_id;
+
+	position::chunk_in_world center;
+	position::chunk_in_world::value_type render_distance;
+	std::vector<position::chunk_in_world> offsets;
+	std::vector<cell> cells;
+	std::vector<position::chunk_in_world> present;
+	std::vector<position::chunk_in_world> added; // put in present at the next frame
+	bool removed; // whether present has positions that lost their chunk
+	std::size_t missing_cursor; // index in offsets
+	std::vector<position::chunk_in_world> missing;
+	uint64_t frame;
+};
+
 /**
  * @return The amount of chunks considered for drawing and the amount of chunks drawn
  */
 std::tuple<uint64_t, uint64_t> draw_world
 (
+	chunk_view&,
 	world::world&,
 	resource_manager&,
 	const glm::dmat4& vp_matrix,
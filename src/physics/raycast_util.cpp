@@ -16,6 +16,7 @@
 #include "physics/ray.hpp"
 #include "physics/raycast_hit.hpp"
 #include "position/block_in_world.hpp"
+#include "util/epoch.hpp"
 #include "world/world.hpp"
 
 using std::nullopt;
@@ -199,6 +200,8 @@ std::optional<raycast_hit> raycast
 	const glm::dvec3 min = r.origin - radius;
 	const glm::dvec3 max = r.origin + radius;
 
+	// one guard for the whole walk, so that each get_block does not synchronize
+	const util::epoch::guard g;
 	while(// ray has not gone past bounds of world
 			(step.x > 0 ? cube_pos.x < max.x : cube_pos.x > min.x) &&
 			(step.y > 0 ? cube_pos.y < max.y : cube_pos.y > min.y) &&
@@ -15,10 +15,20 @@ uint64_t hasher(const T& pos)
 	const uint64_t x = pos.x & 0x3FFFFF;
 	const uint64_t y = pos.y & 0x1FFFFF;
 	const uint64_t z = pos.z & 0x1FFFFF;
-	return	  (x << 42)
-			| (y << 21)
-			| (z)
+	uint64_t h =  (x << 42)
+				| (y << 21)
+				| (z)
 		;
+
+	// the packed bits are mixed so that every bit of the hash depends on x, y, and z
+	// otherwise the low bits (which pick the bucket) are only z, and the high bits only x
+	// this is the finalizer of MurmurHash3
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCD;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53;
+	h ^= h >> 33;
+	return h;
 }
 
 template<typename P>
@@ -1,7 +1,10 @@
 #include "resource_manager.hpp"
 
 #include <atomic>
+#include <cassert>
 #include <chrono>
+#include <limits>
+#include <optional>
 #include <mutex>
 #include <regex>
 #include <sstream>
@@ -15,6 +18,7 @@
 #include "block/base.hpp"
 #include "block/textured.hpp"
 #include "block/enums/visibility_type.hpp"
+#include "chunk/Mesher/render_traits.hpp"
 #include "console/ArgumentParser.hpp"
 #include "graphics/image.hpp"
 #include "graphics/opengl/shader_object.hpp"
@@ -77,8 +81,11 @@ struct resource_manager::impl
 	impl()
 	:
 		main_thread_id(std::this_thread::get_id()),
-		units(1)
+		units(1),
+		render_traits(std::make_shared<mesher::render_traits>())
 	{
+		material_paths.emplace_back();
+		material_ids.emplace(string(), 0);
 	}
 
 	block_texture& get_block_texture(uint32_t res)
@@ -116,6 +123,15 @@ struct resource_manager::impl
 	uint8_t units;
 	mutable std::mutex block_textures_mutex;
 
+	// read by the mesh threads, so it is replaced with std::atomic_store instead of modified
+	std::shared_ptr<const mesher::render_traits> render_traits;
+
+	std::vector<fs::path> material_paths;
+	std::unordered_map<string, mesher::material_id_t> material_ids;
+	mutable std::mutex materials_mutex;
+	// only used by the main thread, so it is not locked
+	std::vector<std::optional<resource<shader_program>>> material_programs;
+
 	// note: fs::path can not be a key because it can not be hashed
 	std::unordered_map<string, unique_ptr<graphics::image>> cache_image;
 	mutable std::mutex cache_image_mutex;
@@ -360,6 +376,8 @@ void resource_manager::load_blocks(game& game)
 			#undef c
 		}
 	}
+
+	update_render_traits(game.block_registry);
 }
 
 resource_manager::block_texture_info resource_manager::get_block_texture(fs::path path)
@@ -428,6 +446,12 @@ resource_manager::block_texture_info resource_manager::get_block_texture(fs::pat
 			t.tex.image3D_sub(0, 0, 0, depth, res, res, 1, GL_RGBA, GL_UNSIGNED_BYTE, image->get_data());
 			glActiveTexture(GL_TEXTURE0);
 			LOG(INFO) << "reloaded " << path.u8string() << " (layer " << depth << " of unit " << std::to_string(t.unit) << ")\n";
+
+			// this is called with cache_image_mutex locked, which update_render_traits needs
+			pImpl->work.enqueue([this]()
+			{
+				update_render_traits(game::instance->block_registry);
+			});
 		});
 		glActiveTexture(GL_TEXTURE0 + t.unit);
 		t.tex.image3D_sub(0, 0, 0, depth, res, res, 1, GL_RGBA, GL_UNSIGNED_BYTE, image->get_data());
@@ -442,6 +466,17 @@ resource_manager::block_texture_info resource_manager::get_block_texture(fs::pat
 	};
 }
 
+void resource_manager::update_render_traits(const block::BlockRegistry& block_registry)
+{
+	auto render_traits = std::make_shared<const mesher::render_traits>(block_registry, *this);
+	std::atomic_store(&pImpl->render_traits, std::shared_ptr<const mesher::render_traits>(std::move(render_traits)));
+}
+
+std::shared_ptr<const mesher::render_traits> resource_manager::get_render_traits() const
+{
+	return std::atomic_load(&pImpl->render_traits);
+}
+
 bool resource_manager::texture_has_transparency(const fs::path& path)
 {
 	return get_image("textures" / path)->has_transparency();
@@ -610,4 +645,46 @@ void resource_manager::foreach_shader_program(const std::function<void(resource<
 	}
 }
 
+mesher::material_id_t resource_manager::get_material_id(const fs::path& shader_path)
+{
+	std::lock_guard<std::mutex> g(pImpl->materials_mutex);
+	const auto i = pImpl->material_ids.find(shader_path.string());
+	if(i != pImpl->material_ids.cend())
+	{
+		return i->second;
+	}
+	if(pImpl->material_paths.size() > std::numeric_limits<mesher::material_id_t>::max())
+	{
+		throw std::runtime_error("too many materials");
+	}
+	const auto id = static_cast<mesher::material_id_t>(pImpl->material_paths.size());
+	pImpl->material_paths.emplace_back(shader_path);
+	pImpl->material_ids.emplace(shader_path.string(), id);
+	return id;
+}
+
+fs::path resource_manager::get_material_path(const mesher::material_id_t id) const
+{
+	std::lock_guard<std::mutex> g(pImpl->materials_mutex);
+	return pImpl->material_paths.at(id);
+}
+
+resource<shader_program> resource_manager::get_material_program(const mesher::material_id_t id)
+{
+	assert(std::this_thread::get_id() == pImpl->main_thread_id);
+	assert(id != 0);
+
+	if(id >= pImpl->material_programs.size())
+	{
+		pImpl->material_programs.resize(id + 1u);
+	}
+	std::optional<resource<shader_program>>& program = pImpl->material_programs[id];
+	if(program == std::nullopt)
+	{
+		// the resource points into the program cache, so it stays valid when the program is reloaded
+		program = get_shader_program(get_material_path(id));
+	}
+	return *program;
+}
+
 }
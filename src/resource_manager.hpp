@@ -8,6 +8,9 @@
 #include <vector>
 
 #include "fwd/game.hpp"
+#include "fwd/block/BlockRegistry.hpp"
+#include "fwd/chunk/Mesher/Base.hpp"
+#include "fwd/chunk/Mesher/render_traits.hpp"
 #include "fwd/graphics/image.hpp"
 #include "fwd/graphics/opengl/shader_object.hpp"
 #include "fwd/graphics/opengl/shader_program.hpp"
@@ -87,6 +90,12 @@ public:
 	block_texture_info get_block_texture(fs::path);
 	bool texture_has_transparency(const fs::path&);
 
+	/**
+	 * Remake the table returned by `get_render_traits` (after blocks are added)
+	 */
+	void update_render_traits(const block::BlockRegistry&);
+	std::shared_ptr<const mesher::render_traits> get_render_traits() const;
+
 	bool has_image(const fs::path&) const;
 	resource<graphics::image> get_image(const fs::path&, bool reload = false);
 
@@ -98,6 +107,16 @@ public:
 	resource<graphics::opengl::shader_program> get_shader_program(const fs::path&, bool reload = false);
 	void foreach_shader_program(const std::function<void(resource<graphics::opengl::shader_program>)>&);
 
+	/**
+	 * Material IDs are small integers for shader program paths, so that meshes can be keyed and drawn without paths.
+	 * The same path always gets the same ID, and the empty path is 0.
+	 */
+	mesher::material_id_t get_material_id(const fs::path& shader_path);
+	fs::path get_material_path(mesher::material_id_t) const;
+
+	// must be called from the main thread
+	resource<graphics::opengl::shader_program> get_material_program(mesher::material_id_t);
+
 private:
 	struct impl;
 	std::propagate_const<std::unique_ptr<impl>> pImpl;
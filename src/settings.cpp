@@ -128,6 +128,7 @@ void load()
 {
 	settings =
 	{
+		{"chunk_budget"			, 4096}, // how many chunks to keep in memory before unloading ones out of range
 		{"crosshair_color"		, glm::dvec4(1.0)},
 		{"crosshair_size"		, 32},
 		{"crosshair_thickness"	, 2},
@@ -142,7 +143,9 @@ void load()
 		{"joystick_mouse_speed"	, 16.0},
 		{"joystick_sensitivity"	, 4.0},
 		{"language"				, "en"},
+		{"light_budget"			, 2.0},
 		{"light_smoothing"		, 2},
+		{"mesh_format"			, "quads"},
 		{"mesher"				, "Simple"},
 		{"mouse_sensitivity"	, 0.1},
 		{"min_light"			, 0.005},
@@ -155,6 +158,7 @@ void load()
 		{"show_container_bounds", false},
 		{"show_debug_info"		, false},
 		{"show_HUD"				, true},
+		{"unload_margin"		, 2}, // chunks this far past the render distance are not unloaded
 		{"wireframe"			, false},
 	};
 
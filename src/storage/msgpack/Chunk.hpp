@@ -1,24 +1,103 @@
 #pragma once
 
+#include <array>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
+#include "block/enums/Face.hpp"
 #include "chunk/Chunk.hpp"
 #include "chunk/ChunkData.hpp"
+#include "position/chunk_in_world.hpp"
+#include "storage/msgpack_util.hpp"
 #include "storage/msgpack/block.hpp"
 #include "storage/msgpack/ChunkData.hpp"
+#include "storage/msgpack/color.hpp"
+#include "world/heightmap.hpp"
+#include "world/world.hpp"
 
 namespace block_thingy {
 
+// saved light with another version is ignored, and the chunk is lit again after loading
+// change this when light is spread differently
+constexpr uint32_t light_format_version = 2;
+
 template<>
 void Chunk::save(msgpack::packer<zstr::ostream>& o) const
 {
-	o.pack(this->blocks);
+	// light is saved once it has spread into the chunk
+	if(get_stage() < stage::lit)
+	{
+		o.pack_map(1);
+		o.pack("blocks"); o.pack(this->blocks);
+		return;
+	}
+
+	// the stamps are read before the light, so that light changed while saving makes a stamp not match instead of being missed
+	const uint64_t light_stamp = get_light_stamp();
+	std::array<uint64_t, 6> neighbor_light_stamps;
+	for(uint8_t face_i = 0; face_i < 6; ++face_i)
+	{
+		const glm::ivec3 vec = block::enums::face_to_vec(static_cast<block::enums::Face>(face_i));
+		const std::shared_ptr<Chunk> neighbor = get_neighbor(vec);
+		neighbor_light_stamps[face_i] = (neighbor != nullptr) ? neighbor->get_light_stamp() : 0;
+	}
+	// where the sky reached when the sky light was spread, so that loading can tell if it still does
+	const chunk_sky_floor_t sky_floor = get_owner().get_heightmap().get_sky_floor(get_position());
+
+	o.pack_map(2);
+	o.pack("blocks"); o.pack(this->blocks);
+	o.pack("light");
+	o.pack_map(6);
+	o.pack("version"); o.pack(light_format_version);
+	o.pack("stamp"); o.pack(light_stamp);
+	o.pack("neighbor_stamps"); o.pack(neighbor_light_stamps);
+	o.pack("sky_floor"); o.pack(sky_floor);
+	o.pack("values"); o.pack(this->blocklight);
+	o.pack("sky_values"); o.pack(this->skylight);
 }
 
 template<>
 void Chunk::load(const msgpack::object& o)
 {
-	this->set_blocks(o.as<ChunkData<std::shared_ptr<block::base>>>());
+	// chunks saved before light was saved have only the blocks
+	if(o.type == msgpack::type::ARRAY)
+	{
+		this->set_blocks(o.as<chunk_blocks_t>());
+		return;
+	}
+	if(o.type != msgpack::type::MAP) throw msgpack::type_error();
+
+	const auto map = o.as<std::map<std::string, msgpack::object>>();
+	msgpack::object blocks_object;
+	storage::find_in_map_or_throw(map, "blocks", blocks_object);
+	this->set_blocks(blocks_object.as<chunk_blocks_t>());
+
+	msgpack::object light_object;
+	if(!storage::find_in_map(map, "light", light_object))
+	{
+		return;
+	}
+	const auto light_map = light_object.as<std::map<std::string, msgpack::object>>();
+	uint32_t version = 0;
+	storage::find_in_map(light_map, "version", version);
+	if(version != light_format_version)
+	{
+		return;
+	}
+	uint64_t light_stamp;
+	storage::find_in_map_or_throw(light_map, "stamp", light_stamp);
+	std::array<uint64_t, 6> neighbor_light_stamps;
+	storage::find_in_map_or_throw(light_map, "neighbor_stamps", neighbor_light_stamps);
+	chunk_sky_floor_t sky_floor;
+	storage::find_in_map_or_throw(light_map, "sky_floor", sky_floor);
+	chunk_light_t light;
+	storage::find_in_map_or_throw(light_map, "values", light);
+	chunk_skylight_t sky_light;
+	storage::find_in_map_or_throw(light_map, "sky_values", sky_light);
+	this->set_light(std::move(light), std::move(sky_light), light_stamp, neighbor_light_stamps, sky_floor);
 }
 
 }
@@ -1,48 +1,75 @@
 #pragma once
 
-#include <cassert>
-#include <unordered_map>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <vector>
 
 #include "chunk/ChunkData.hpp"
 
 namespace block_thingy {
 
-using T = std::shared_ptr<block::base>;
-
-template<>
-template<>
-void ChunkData<T>::save(msgpack::packer<zstr::ostream>& o) const
+// the same format is used for blocks and for light
+template<typename T>
+template<typename O>
+void ChunkData<T>::save(O& o) const
 {
+	const snapshot s = copy_out();
+
 	o.pack_array(2);
 
+	if(s.indices.empty())
+	{
+		// uniform chunks are saved without indices
+		o.pack_array(1);
+		o.pack(s.palette[0]);
+		o.pack_array(0);
+		return;
+	}
+
+	// unused palette slots are skipped, so the saved indices are remapped to be contiguous
+	std::vector<bool> used(s.palette.size(), false);
+	for(const palette_index_t index : s.indices)
+	{
+		used[index] = true;
+	}
 	std::vector<T> block_vec;
-	std::unordered_map<T::element_type*, uint32_t> block_map;
-	uint32_t block_i = 0;
-	for(auto& block : this->blocks)
+	std::vector<uint32_t> block_map(s.palette.size());
+	for(std::size_t i = 0; i < s.palette.size(); ++i)
 	{
-		auto i = block_map.find(block.get());
-		if(i == block_map.cend())
+		if(used[i])
 		{
-			block_vec.emplace_back(block);
-			block_map.emplace(block.get(), block_i++);
+			block_map[i] = static_cast<uint32_t>(block_vec.size());
+			block_vec.emplace_back(s.palette[i]);
 		}
 	}
 
 	o.pack(block_vec);
 
-	assert(this->blocks.size() <= std::numeric_limits<uint32_t>::max());
-	o.pack_array(static_cast<uint32_t>(this->blocks.size()));
-	for(auto& block : this->blocks)
+	// the indices are saved as one blob of little-endian values, 1 byte each if they fit or 2 bytes otherwise
+	const std::size_t width = block_vec.size() <= 256 ? 1 : 2;
+	std::vector<char> bytes(CHUNK_BLOCK_COUNT * width);
+	for(std::size_t i = 0; i < CHUNK_BLOCK_COUNT; ++i)
 	{
-		o.pack(block_map[block.get()]);
+		const uint32_t index = block_map[s.indices[i]];
+		bytes[i * width] = static_cast<char>(index & 0xFF);
+		if(width == 2)
+		{
+			bytes[i * width + 1] = static_cast<char>(index >> 8);
+		}
 	}
+	o.pack_bin(static_cast<uint32_t>(bytes.size()));
+	o.pack_bin_body(bytes.data(), static_cast<uint32_t>(bytes.size()));
 }
 
-template<>
-template<>
-void ChunkData<T>::load(const msgpack::object& o)
+template<typename T>
+template<typename O>
+void ChunkData<T>::load(const O& object)
 {
+	const msgpack::object& o = object;
+
 	if(o.type != msgpack::type::ARRAY)
 	{
 		throw msgpack::type_error();
@@ -51,24 +78,126 @@ void ChunkData<T>::load(const msgpack::object& o)
 	{
 		throw msgpack::type_error();
 	}
-	const auto v = o.as<std::array<msgpack::object, 2>>();
+	const msgpack::object& palette_object = o.via.array.ptr[0];
+	const msgpack::object& indices_object = o.via.array.ptr[1];
 
-	const auto block_vec = v[0].as<std::vector<T>>();
+	const auto block_vec = palette_object.as<std::vector<T>>();
 
-	if(v[1].type != msgpack::type::ARRAY)
+	if(indices_object.type == msgpack::type::ARRAY && indices_object.via.array.size == 0)
 	{
-	 throw msgpack::type_error();
+		if(block_vec.size() != 1)
+		{
+			throw msgpack::type_error();
+		}
+		fill(block_vec[0]);
+		return;
 	}
-	// msgpack errors on > instead of !=
-	if(v[1].via.array.size != CHUNK_BLOCK_COUNT)
+	if(block_vec.empty() || block_vec.size() > CHUNK_BLOCK_COUNT)
 	{
 		throw msgpack::type_error();
 	}
-	const auto block_map = v[1].as<std::array<uint32_t, CHUNK_BLOCK_COUNT>>();
-	for(std::size_t i = 0; i < CHUNK_BLOCK_COUNT; ++i)
+
+	uint8_t new_bits = 1;
+	while((std::size_t(1) << new_bits) < block_vec.size())
+	{
+		new_bits = static_cast<uint8_t>(new_bits * 2);
+	}
+
+	// build the new arrays before publishing them
+	// the saved indices are packed into whole words here, so each word of the new index array is stored once
+	auto new_indices = std::make_unique<index_array>(new_bits);
+	std::vector<uint32_t> new_refs(block_vec.size(), 0);
+	const auto decode = [&new_indices, &new_refs, &block_vec, new_bits](const auto& get_index)
+	{
+		const std::size_t per_word = 64u / new_bits;
+		uint64_t word = 0;
+		for(std::size_t i = 0; i < CHUNK_BLOCK_COUNT; ++i)
+		{
+			const std::size_t index = get_index(i);
+			if(index >= block_vec.size())
+			{
+				throw msgpack::type_error();
+			}
+			new_refs[index] += 1;
+			word |= static_cast<uint64_t>(index) << ((i % per_word) * new_bits);
+			if(i % per_word == per_word - 1)
+			{
+				new_indices->words[i / per_word].store(word, std::memory_order_relaxed);
+				word = 0;
+			}
+		}
+	};
+
+	if(indices_object.type == msgpack::type::BIN)
 	{
-		this->blocks[i] = block_vec[block_map[i]];
+		const msgpack::object_bin& bin = indices_object.via.bin;
+		const std::size_t width = bin.size / CHUNK_BLOCK_COUNT;
+		if((width != 1 && width != 2) || bin.size != CHUNK_BLOCK_COUNT * width)
+		{
+			throw msgpack::type_error();
+		}
+		const auto* bytes = reinterpret_cast<const unsigned char*>(bin.ptr);
+		if(width == 1)
+		{
+			decode([bytes](const std::size_t i) -> std::size_t
+			{
+				return bytes[i];
+			});
+		}
+		else
+		{
+			decode([bytes](const std::size_t i) -> std::size_t
+			{
+				return bytes[2 * i] | (std::size_t(bytes[2 * i + 1]) << 8);
+			});
+		}
+	}
+	else if(indices_object.type == msgpack::type::ARRAY)
+	{
+		// old saves have one object per index
+		const msgpack::object_array& saved_indices = indices_object.via.array;
+		if(saved_indices.size != CHUNK_BLOCK_COUNT)
+		{
+			throw msgpack::type_error();
+		}
+		decode([&saved_indices](const std::size_t i) -> std::size_t
+		{
+			const msgpack::object& index_object = saved_indices.ptr[i];
+			if(index_object.type != msgpack::type::POSITIVE_INTEGER || index_object.via.u64 > CHUNK_BLOCK_COUNT)
+			{
+				throw msgpack::type_error();
+			}
+			return static_cast<std::size_t>(index_object.via.u64);
+		});
+	}
+	else
+	{
+		throw msgpack::type_error();
+	}
+	for(std::size_t i = 0; i < block_vec.size(); ++i)
+	{
+		if(new_refs[i] == static_cast<uint32_t>(CHUNK_BLOCK_COUNT))
+		{
+			fill(block_vec[i]);
+			return;
+		}
 	}
+
+	auto new_palette = std::make_unique<palette_array>(palette_capacity(block_vec.size()));
+	for(std::size_t i = 0; i < block_vec.size(); ++i)
+	{
+		// do not keep unreferenced values alive
+		if(new_refs[i] != 0)
+		{
+			new_palette->entries[i].store(new T(block_vec[i]), std::memory_order_relaxed);
+		}
+	}
+
+	std::lock_guard<std::mutex> g(blocks_mutex);
+	write_begin();
+	palette_refs = std::move(new_refs);
+	replace(new_palette.release(), new_indices.release());
+	write_end();
 }
 
 }
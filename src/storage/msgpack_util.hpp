@@ -65,8 +65,13 @@ void find_in_map_or_throw
 template<typename T>
 void unpack_bytes(const std::string& bytes, T& v)
 {
+	// BIN objects (like chunk indices) point into bytes instead of being copied, which is fine because they are converted before this returns
+	const msgpack::unpack_reference_func reference_bin = [](const msgpack::type::object_type type, std::size_t, void*)
+	{
+		return type == msgpack::type::BIN;
+	};
 	msgpack::unpacked u;
-	msgpack::unpack(u, bytes.c_str(), bytes.length());
+	msgpack::unpack(u, bytes.c_str(), bytes.length(), reference_bin);
 	msgpack::object o = u.get();
 	o.convert(v);
 }
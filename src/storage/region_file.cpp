@@ -0,0 +1,250 @@
+#include "region_file.hpp"
+
+#include <stdexcept>
+
+#include "util/decompress.hpp"
+#include "util/logger.hpp"
+
+using std::string;
+
+namespace block_thingy::storage {
+
+using value_type = position::chunk_in_world::value_type;
+
+// each table entry is 2 uint32s
+constexpr std::size_t entry_size = 8;
+constexpr std::size_t header_sectors = region_file::chunk_count * entry_size / region_file::sector_size;
+
+static value_type floor_div(const value_type a, const value_type b)
+{
+	return (a >= 0) ? a / b : (a - b + 1) / b;
+}
+
+static value_type floor_mod(const value_type a, const value_type b)
+{
+	return ((a % b) + b) % b;
+}
+
+static uint32_t read_u32(const char* p)
+{
+	const auto* u = reinterpret_cast<const unsigned char*>(p);
+	return static_cast<uint32_t>(u[0])
+		| static_cast<uint32_t>(u[1]) << 8
+		| static_cast<uint32_t>(u[2]) << 16
+		| static_cast<uint32_t>(u[3]) << 24;
+}
+
+static void write_u32(char* p, const uint32_t v)
+{
+	p[0] = static_cast<char>(v & 0xFF);
+	p[1] = static_cast<char>((v >> 8) & 0xFF);
+	p[2] = static_cast<char>((v >> 16) & 0xFF);
+	p[3] = static_cast<char>((v >> 24) & 0xFF);
+}
+
+region_file::region_file(const fs::path& path, const position::chunk_in_world& region_position)
+:
+	path(path),
+	region_position(region_position)
+{
+	if(!fs::exists(path))
+	{
+		std::ofstream stream(path, std::ofstream::binary);
+		const string header(header_sectors * sector_size, '\0');
+		stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+		if(!stream)
+		{
+			throw std::runtime_error("error making " + path.u8string());
+		}
+	}
+
+	file.open(path, std::fstream::in | std::fstream::out | std::fstream::binary);
+	if(!file.is_open())
+	{
+		throw std::runtime_error("error opening " + path.u8string());
+	}
+
+	// the table is read once; the file is only mapped when a chunk is read
+	const std::size_t file_size = static_cast<std::size_t>(fs::file_size(path));
+	string header(header_sectors * sector_size, '\0');
+	file.read(&header[0], static_cast<std::streamsize>(header.size()));
+	if(file_size < header.size() || !file)
+	{
+		throw std::runtime_error(path.u8string() + " is too small to be a region file");
+	}
+
+	used_sectors.assign(sectors_for(file_size), false);
+	mark_sectors(0, header_sectors, true);
+	for(std::size_t i = 0; i < chunk_count; ++i)
+	{
+		entry& e = table[i];
+		e.sector = read_u32(header.data() + i * entry_size);
+		e.length = read_u32(header.data() + i * entry_size + 4);
+		if(e.length == 0)
+		{
+			continue;
+		}
+		if(e.sector < header_sectors || std::size_t(e.sector) * sector_size + e.length > file_size)
+		{
+			LOG(ERROR) << "bad table entry " << i << " in " << path.u8string() << "; ignoring it\n";
+			e = {0, 0};
+			continue;
+		}
+		mark_sectors(e.sector, sectors_for(e.length), true);
+	}
+}
+
+position::chunk_in_world region_file::region_of(const position::chunk_in_world& position)
+{
+	return
+	{
+		floor_div(position.x, size),
+		floor_div(position.y, size),
+		floor_div(position.z, size)
+	};
+}
+
+std::optional<string> region_file::read(const position::chunk_in_world& position)
+{
+	std::lock_guard<std::mutex> g(mutex);
+	const entry e = table[index_of(position)];
+	if(e.length == 0)
+	{
+		return std::nullopt;
+	}
+
+	const std::size_t start = std::size_t(e.sector) * sector_size;
+	// a mapping does not grow with the file, so it is made again when a chunk was written past its end
+	if(map == nullptr || start + e.length > map->size())
+	{
+		map = std::make_unique<util::mapped_file>(path);
+	}
+	if(start + e.length > map->size())
+	{
+		LOG(ERROR) << path.u8string() << " is shorter than its table says\n";
+		return std::nullopt;
+	}
+	// decompressed straight from the mapping, so the compressed bytes are not copied first
+	return util::decompress(map->data() + start, e.length);
+}
+
+bool region_file::write(const position::chunk_in_world& position, const string& bytes)
+{
+	const std::size_t i = index_of(position);
+	const std::size_t sectors = sectors_for(bytes.size());
+
+	std::lock_guard<std::mutex> g(mutex);
+	entry& e = table[i];
+	const entry old_entry = e;
+	// the old sectors are still marked used, so the new data does not go over the old data
+	const uint32_t first = allocate(sectors);
+
+	// a mapping sees the new bytes (read makes it again if they are past its end), but a copy does not
+	if(!util::mapped_file::is_mapping)
+	{
+		map = nullptr;
+	}
+
+	file.clear();
+	file.seekp(static_cast<std::streamoff>(std::size_t(first) * sector_size));
+	file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+	// padded to a whole sector, so that the file always ends at the end of a sector
+	const string padding(sectors * sector_size - bytes.size(), '\0');
+	file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+	file.flush();
+	if(!file)
+	{
+		LOG(ERROR) << "error writing " << path.u8string() << '\n';
+		mark_sectors(first, sectors, false);
+		return false;
+	}
+
+	char entry_bytes[entry_size];
+	write_u32(entry_bytes, first);
+	write_u32(entry_bytes + 4, static_cast<uint32_t>(bytes.size()));
+	file.seekp(static_cast<std::streamoff>(i * entry_size));
+	file.write(entry_bytes, entry_size);
+	file.flush();
+	if(!file)
+	{
+		LOG(ERROR) << "error writing the table of " << path.u8string() << '\n';
+		mark_sectors(first, sectors, false);
+		return false;
+	}
+
+	e.sector = first;
+	e.length = static_cast<uint32_t>(bytes.size());
+	if(old_entry.length != 0)
+	{
+		mark_sectors(old_entry.sector, sectors_for(old_entry.length), false);
+	}
+	return true;
+}
+
+std::vector<position::chunk_in_world> region_file::get_chunks()
+{
+	std::vector<position::chunk_in_world> chunks;
+	const position::chunk_in_world base = region_position * size;
+
+	std::lock_guard<std::mutex> g(mutex);
+	for(std::size_t i = 0; i < chunk_count; ++i)
+	{
+		if(table[i].length == 0)
+		{
+			continue;
+		}
+		const auto s = static_cast<std::size_t>(size);
+		chunks.emplace_back
+		(
+			base.x + static_cast<value_type>(i / (s * s)),
+			base.y + static_cast<value_type>(i / s % s),
+			base.z + static_cast<value_type>(i % s)
+		);
+	}
+	return chunks;
+}
+
+std::size_t region_file::index_of(const position::chunk_in_world& position)
+{
+	const auto x = static_cast<std::size_t>(floor_mod(position.x, size));
+	const auto y = static_cast<std::size_t>(floor_mod(position.y, size));
+	const auto z = static_cast<std::size_t>(floor_mod(position.z, size));
+	const auto s = static_cast<std::size_t>(size);
+	return (x * s + y) * s + z;
+}
+
+std::size_t region_file::sectors_for(const std::size_t length)
+{
+	return (length + sector_size - 1) / sector_size;
+}
+
+uint32_t region_file::allocate(const std::size_t sectors)
+{
+	std::size_t run = 0;
+	for(std::size_t i = header_sectors; i < used_sectors.size(); ++i)
+	{
+		run = used_sectors[i] ? 0 : run + 1;
+		if(run == sectors)
+		{
+			const std::size_t first = i + 1 - sectors;
+			mark_sectors(first, sectors, true);
+			return static_cast<uint32_t>(first);
+		}
+	}
+
+	// a free run at the end of the file is extended
+	const std::size_t first = used_sectors.size() - run;
+	used_sectors.resize(first + sectors, false);
+	mark_sectors(first, sectors, true);
+	return static_cast<uint32_t>(first);
+}
+
+void region_file::mark_sectors(const std::size_t first, const std::size_t count, const bool used)
+{
+	for(std::size_t i = first; i < first + count; ++i)
+	{
+		used_sectors[i] = used;
+	}
+}
+
+}
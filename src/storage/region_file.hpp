@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "position/chunk_in_world.hpp"
+#include "util/filesystem.hpp"
+#include "util/mapped_file.hpp"
+
+namespace block_thingy::storage {
+
+/**
+ * Stores the chunks of a region (a cube of `size`³ chunks) in one file.
+ *
+ * The file starts with a table that has an entry for each chunk of the region:
+ * the sector where its data starts and the length of its data in bytes (0 if
+ * the chunk is not saved), both little-endian uint32s. The data of a chunk
+ * takes whole sectors after the table, in the first free run of sectors that
+ * is long enough (or at the end of the file). A chunk that is saved again gets
+ * new sectors, and its old ones are freed once the table points away from
+ * them, so a write that fails leaves the old data.
+ *
+ * The table is read when the file is opened. Reads come from a memory map of the file,
+ * which is made by the first read and made again when a read is past its end.
+ * All methods can be called from any thread.
+ */
+class region_file
+{
+public:
+	static constexpr position::chunk_in_world::value_type size = 16;
+	static constexpr std::size_t chunk_count = static_cast<std::size_t>(size * size * size);
+	static constexpr std::size_t sector_size = 4096;
+
+	/**
+	 * Open the file of the region at the position, making an empty one if it does not exist
+	 *
+	 * @throws std::runtime_error if the file can not be opened
+	 */
+	region_file(const fs::path& path, const position::chunk_in_world& region_position);
+
+	region_file(region_file&&) = delete;
+	region_file(const region_file&) = delete;
+	region_file& operator=(region_file&&) = delete;
+	region_file& operator=(const region_file&) = delete;
+
+	/**
+	 * @return The position of the region that has the chunk
+	 */
+	static position::chunk_in_world region_of(const position::chunk_in_world&);
+
+	/**
+	 * The stored bytes are gzip or zlib data, and are decompressed while the region is locked
+	 *
+	 * @return The decompressed bytes of the chunk, or std::nullopt if the chunk is not saved
+	 * @throws std::runtime_error if the stored bytes can not be decompressed
+	 */
+	std::optional<std::string> read(const position::chunk_in_world&);
+
+	/**
+	 * Store bytes for the chunk, replacing any that were stored before
+	 *
+	 * @param bytes Must not be empty
+	 * @return `false` if the bytes could not be written, in which case the bytes stored before are kept
+	 */
+	bool write(const position::chunk_in_world&, const std::string& bytes);
+
+	/**
+	 * @return The positions of the chunks that are saved in this region
+	 */
+	std::vector<position::chunk_in_world> get_chunks();
+
+private:
+	struct entry
+	{
+		uint32_t sector;
+		uint32_t length;
+	};
+
+	static std::size_t index_of(const position::chunk_in_world&);
+	static std::size_t sectors_for(std::size_t length);
+	uint32_t allocate(std::size_t sectors);
+	void mark_sectors(std::size_t first, std::size_t count, bool used);
+
+	fs::path path;
+	position::chunk_in_world region_position;
+	std::mutex mutex;
+	std::fstream file;
+	std::unique_ptr<util::mapped_file> map;
+	std::array<entry, chunk_count> table;
+	std::vector<bool> used_sectors;
+};
+
+}
@@ -1,9 +1,12 @@
 #include "world_file.hpp"
 
 #include <fstream>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <msgpack.hpp>
 #include <zstr/zstr.hpp>
@@ -16,7 +19,6 @@
 #include "storage/msgpack/Chunk.hpp"
 #include "storage/msgpack/Player.hpp"
 #include "storage/msgpack/world.hpp"
-#include "util/copy_stream.hpp"
 #include "util/filesystem.hpp"
 #include "util/logger.hpp"
 #include "util/misc.hpp"
@@ -31,11 +33,17 @@ world_file::world_file(const fs::path& world_dir, world::world& world)
 :
 	world_path(world_dir / "world"),
 	player_dir(world_dir / "players"),
-	chunk_dir(world_dir / "chunks"),
+	region_dir(world_dir / "regions"),
 	world(world)
 {
 	fs::create_directories(player_dir);
-	fs::create_directories(chunk_dir);
+	fs::create_directories(region_dir);
+	const fs::path chunk_dir = world_dir / "chunks";
+	if(fs::exists(chunk_dir))
+	{
+		convert_chunk_files(chunk_dir);
+	}
+	find_saved_chunks();
 
 	if(!fs::exists(world_path))
 	{
@@ -103,41 +111,66 @@ unique_ptr<Player> world_file::load_player
 
 void world_file::save_chunk(const Chunk& chunk)
 {
-	position::chunk_in_world position = chunk.get_position();
-	fs::path file_path = chunk_path(position);
-	LOG(INFO) << "saving " << file_path.u8string() << '\n';
+	const position::chunk_in_world position = chunk.get_position();
+	LOG(INFO) << "saving chunk " << position << '\n';
+
+	std::ostringstream compressed;
+	{
+		zstr::ostream stream(compressed);
+		msgpack::pack(stream, chunk);
+	}
 
-	std::ofstream stdstream(file_path, std::ofstream::binary);
-	zstr::ostream stream(stdstream);
-	msgpack::pack(stream, chunk);
+	region_file* region = get_region(position, true);
+	if(region == nullptr)
+	{
+		return;
+	}
+	if(!region->write(position, compressed.str()))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> g(saved_chunks_mutex);
+	saved_chunks.emplace(position);
 }
 
 unique_ptr<Chunk> world_file::load_chunk(const position::chunk_in_world& position)
 {
-	fs::path file_path = chunk_path(position);
-	if(!fs::exists(file_path))
+	region_file* region = get_region(position, false);
+	if(region == nullptr)
+	{
+		return nullptr;
+	}
+	std::optional<string> bytes;
+	try
+	{
+		bytes = region->read(position);
+	}
+	catch(const std::runtime_error& e)
+	{
+		LOG(ERROR) << "error loading chunk " << position << ": " << e.what() << '\n';
+		return nullptr;
+	}
+	if(bytes == std::nullopt)
 	{
 		return nullptr;
 	}
 
-	std::ifstream stdstream(file_path, std::ifstream::binary);
-	zstr::istream stream(stdstream);
-	string bytes = util::read_stream(stream);
 	auto chunk = std::make_unique<Chunk>(position, world);
 	try
 	{
-		unpack_bytes(bytes, *chunk);
+		unpack_bytes(*bytes, *chunk);
 	}
 	catch(const msgpack::v1::insufficient_bytes& e)
 	{
 		// TODO: load truncated chunks
-		LOG(ERROR) << "error loading " << file_path.u8string() << ": " << e.what() << '\n';
+		LOG(ERROR) << "error loading chunk " << position << ": " << e.what() << '\n';
 		return nullptr;
 	}
 	catch(const msgpack::type_error& e)
 	{
-		LOG(ERROR) << "error loading " << file_path.u8string() << ": " << e.what() << '\n';
-		// TODO: rename the bad file so the user can attempt to recover it (because the new chunk will overwrite it)
+		LOG(ERROR) << "error loading chunk " << position << ": " << e.what() << '\n';
+		// TODO: keep the bad data so the user can attempt to recover it (because the new chunk will overwrite it)
 		return nullptr;
 	}
 	//catch(const std::exception& e)
@@ -147,16 +180,157 @@ unique_ptr<Chunk> world_file::load_chunk(const position::chunk_in_world& positio
 
 bool world_file::has_chunk(const position::chunk_in_world& position)
 {
-	fs::path file_path = chunk_path(position);
-	return fs::exists(file_path);
+	std::lock_guard<std::mutex> g(saved_chunks_mutex);
+	return saved_chunks.find(position) != saved_chunks.cend();
+}
+
+region_file* world_file::get_region(const position::chunk_in_world& chunk_pos, const bool create)
+{
+	const position::chunk_in_world region_pos = region_file::region_of(chunk_pos);
+
+	std::lock_guard<std::mutex> g(regions_mutex);
+	const auto i = regions.find(region_pos);
+	if(i != regions.cend())
+	{
+		return i->second.get();
+	}
+
+	const fs::path path = region_dir / (position_name(region_pos) + ".region");
+	if(!create && !fs::exists(path))
+	{
+		return nullptr;
+	}
+	try
+	{
+		auto region = std::make_unique<region_file>(path, region_pos);
+		region_file* p = region.get();
+		regions.emplace(region_pos, std::move(region));
+		return p;
+	}
+	catch(const std::runtime_error& e)
+	{
+		LOG(ERROR) << e.what() << '\n';
+		return nullptr;
+	}
+}
+
+void world_file::convert_chunk_files(const fs::path& chunk_dir)
+{
+	std::vector<std::pair<position::chunk_in_world, fs::path>> files;
+	for(const fs::directory_entry& entry : fs::directory_iterator(chunk_dir))
+	{
+		const fs::path& path = entry.path();
+		if(path.extension() != ".gz")
+		{
+			continue;
+		}
+		const std::optional<position::chunk_in_world> position = parse_position(path.stem().u8string());
+		if(position != std::nullopt)
+		{
+			files.emplace_back(*position, path);
+		}
+	}
+	if(files.empty())
+	{
+		return;
+	}
+
+	LOG(INFO) << "moving " << files.size() << " chunk files from " << chunk_dir.u8string() << " into region files\n";
+	std::size_t moved = 0;
+	for(const auto& p : files)
+	{
+		const position::chunk_in_world& position = p.first;
+		const fs::path& path = p.second;
+		// the files are already compressed the same way, so the bytes are copied as they are
+		const string bytes = util::read_file(path);
+		if(bytes.empty())
+		{
+			LOG(WARN) << "ignoring empty chunk file " << path.u8string() << '\n';
+			continue;
+		}
+		region_file* region = get_region(position, true);
+		if(region == nullptr)
+		{
+			continue;
+		}
+		// the old file is kept if its bytes could not be written
+		if(!region->write(position, bytes))
+		{
+			continue;
+		}
+		fs::remove(path);
+		moved += 1;
+	}
+	LOG(INFO) << "moved " << moved << " of " << files.size() << " chunk files\n";
+
+	if(fs::is_empty(chunk_dir))
+	{
+		fs::remove(chunk_dir);
+	}
+}
+
+void world_file::find_saved_chunks()
+{
+	// the names are made by get_region: x_y_z.region
+	std::unordered_set<position::chunk_in_world, position::hasher_struct<position::chunk_in_world>> found;
+	for(const fs::directory_entry& entry : fs::directory_iterator(region_dir))
+	{
+		const fs::path& path = entry.path();
+		if(path.extension() != ".region")
+		{
+			continue;
+		}
+		const std::optional<position::chunk_in_world> region_pos = parse_position(path.stem().u8string());
+		if(region_pos == std::nullopt)
+		{
+			continue;
+		}
+		// any chunk of the region gives the region
+		region_file* region = get_region(*region_pos * region_file::size, false);
+		if(region == nullptr)
+		{
+			continue;
+		}
+		for(const position::chunk_in_world& position : region->get_chunks())
+		{
+			found.emplace(position);
+		}
+	}
+	LOG(INFO) << "found " << found.size() << " saved chunks\n";
+
+	std::lock_guard<std::mutex> g(saved_chunks_mutex);
+	saved_chunks = std::move(found);
+}
+
+std::optional<position::chunk_in_world> world_file::parse_position(const string& name)
+{
+	const string::size_type sep1 = name.find('_');
+	const string::size_type sep2 = (sep1 == string::npos) ? string::npos : name.find('_', sep1 + 1);
+	if(sep2 == string::npos)
+	{
+		return std::nullopt;
+	}
+	const string x = name.substr(0, sep1);
+	const string y = name.substr(sep1 + 1, sep2 - sep1 - 1);
+	const string z = name.substr(sep2 + 1);
+	if(!util::is_integer(x) || !util::is_integer(y) || !util::is_integer(z))
+	{
+		return std::nullopt;
+	}
+	return position::chunk_in_world
+	(
+		static_cast<position::chunk_in_world::value_type>(util::stoll(x)),
+		static_cast<position::chunk_in_world::value_type>(util::stoll(y)),
+		static_cast<position::chunk_in_world::value_type>(util::stoll(z))
+	);
 }
 
-fs::path world_file::chunk_path(const position::chunk_in_world& position)
+string world_file::position_name(const position::chunk_in_world& position)
 {
 	const string x = std::to_string(position.x);
 	const string y = std::to_string(position.y);
 	const string z = std::to_string(position.z);
-	return chunk_dir / (x + '_' + y + '_' + z + ".gz");
+	return x + '_' + y + '_' + z;
 }
 
 }
@@ -1,16 +1,25 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_set>
 
 #include "fwd/Player.hpp"
 #include "fwd/chunk/Chunk.hpp"
-#include "fwd/position/chunk_in_world.hpp"
+#include "position/chunk_in_world.hpp"
+#include "position/hash.hpp"
+#include "storage/region_file.hpp"
 #include "util/filesystem.hpp"
 #include "fwd/world/world.hpp"
 
 namespace block_thingy::storage {
 
+/**
+ * Chunks are saved in region files (see region_file) in the `regions` directory.
+ * Worlds from before region files kept each chunk in its own file in the `chunks` directory; those are moved into region files when the world is opened.
+ */
 class world_file
 {
 public:
@@ -60,15 +69,39 @@ public:
 	 */
 	std::unique_ptr<Chunk> load_chunk(const position::chunk_in_world&);
 
+	/**
+	 * This is answered from the chunks found when the world was opened plus the ones saved since, so it does not touch the disk
+	 */
 	bool has_chunk(const position::chunk_in_world&);
 
 private:
 	fs::path world_path;
 	fs::path player_dir;
-	fs::path chunk_dir;
+	fs::path region_dir;
 	world::world& world;
 
-	fs::path chunk_path(const position::chunk_in_world&);
+	position::unordered_map_t<position::chunk_in_world, std::unique_ptr<region_file>> regions;
+	std::mutex regions_mutex;
+	/**
+	 * @param create Whether to make the region file if it does not exist
+	 * @return The region that has the chunk, or `nullptr` if it does not exist (and `create` is false) or can not be opened
+	 */
+	region_file* get_region(const position::chunk_in_world& chunk_pos, bool create);
+
+	/**
+	 * Move chunks saved in the old layout (a gzip file for each chunk) into region files
+	 */
+	void convert_chunk_files(const fs::path& chunk_dir);
+
+	std::unordered_set<position::chunk_in_world, position::hasher_struct<position::chunk_in_world>> saved_chunks;
+	std::mutex saved_chunks_mutex;
+	void find_saved_chunks();
+
+	/**
+	 * Parse a file name of the form x_y_z (used for both chunk files and region files)
+	 */
+	static std::optional<position::chunk_in_world> parse_position(const std::string&);
+	static std::string position_name(const position::chunk_in_world&);
 };
 
 }
@@ -1,51 +1,62 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <mutex>
-#include <thread>
+#include <optional>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
-#include <concurrentqueue/concurrentqueue.hpp>
+#include "util/job_scheduler.hpp"
+#include "util/logger.hpp"
 
 namespace block_thingy::util {
 
+/**
+ * The queue of one stage of work, done by the threads of a `job_scheduler`
+ */
 template
 <
 	typename T,
 	typename Hash = std::hash<T>
 >
-class ThreadThingy
+class ThreadThingy : public job_scheduler::source
 {
 public:
+	/**
+	 * In priority mode, things with a lower priority are done first, and a thing without a priority is cancelled
+	 */
+	using priority_t = double;
+	using priority_func_t = std::function<std::optional<priority_t>(const T&)>;
+
+	/**
+	 * Do things in the order they are enqueued, or in order of priority if `priority` is not null.
+	 * A priority is found when a thing is enqueued and again by `reprioritize`.
+	 *
+	 * @param rank The scheduler takes things from stages with a lower rank first
+	 */
 	ThreadThingy
 	(
 		std::function<void(T&)> f,
-		std::size_t thread_count,
-		const Hash& hash = Hash()
+		job_scheduler& scheduler,
+		const int rank,
+		const Hash& hash = Hash(),
+		priority_func_t priority = nullptr
 	)
 	:
-		queued(0, hash),
-		running(true)
+		f(std::move(f)),
+		scheduler(scheduler),
+		priority(std::move(priority)),
+		running(true),
+		active(0),
+		queued(0, hash)
 	{
-		auto g = [this, f]()
-		{
-			T thing;
-			while(running)
-			{
-				if(things.try_dequeue(thing))
-				{
-					f(thing);
-				}
-				using namespace std::chrono_literals;
-				std::this_thread::sleep_for(10ms);
-			}
-		};
-		for(std::size_t i = 0; i < thread_count; ++i)
-		{
-			threads.emplace_back(g);
-		}
+		scheduler.add_source(*this, rank);
 	}
 
 	~ThreadThingy()
@@ -53,6 +64,11 @@ public:
 		stop();
 	}
 
+	ThreadThingy(ThreadThingy&&) = delete;
+	ThreadThingy(const ThreadThingy&) = delete;
+	ThreadThingy& operator=(ThreadThingy&&) = delete;
+	ThreadThingy& operator=(const ThreadThingy&) = delete;
+
 	void enqueue(const T& thing)
 	{
 		bool emplaced;
@@ -60,9 +76,73 @@ public:
 			std::lock_guard<std::mutex> g(queued_mutex);
 			emplaced = queued.emplace(thing).second;
 		}
-		if(emplaced)
+		if(!emplaced)
+		{
+			return;
+		}
+
+		if(priority == nullptr)
+		{
+			std::lock_guard<std::mutex> g(things_mutex);
+			fifo.emplace_back(thing);
+		}
+		else
+		{
+			const std::optional<priority_t> p = priority(thing);
+			if(p == std::nullopt)
+			{
+				std::lock_guard<std::mutex> g(queued_mutex);
+				queued.erase(thing);
+				return;
+			}
+			std::lock_guard<std::mutex> g(things_mutex);
+			heap.emplace_back(*p, thing);
+			std::push_heap(heap.begin(), heap.end(), heap_compare);
+		}
+		scheduler.notify();
+	}
+
+	/**
+	 * Find the priority of every thing again (such as after the camera moves), and cancel things that no longer have one.
+	 * Cancelled things are forgotten, so they can be enqueued again.
+	 */
+	void reprioritize()
+	{
+		if(priority == nullptr)
+		{
+			return;
+		}
+
+		std::vector<T> cancelled;
 		{
-			things.enqueue(thing);
+			std::lock_guard<std::mutex> g(things_mutex);
+			auto end = heap.end();
+			for(auto i = heap.begin(); i != end;)
+			{
+				const std::optional<priority_t> p = priority(i->second);
+				if(p == std::nullopt)
+				{
+					cancelled.emplace_back(std::move(i->second));
+					--end;
+					std::swap(*i, *end);
+				}
+				else
+				{
+					i->first = *p;
+					++i;
+				}
+			}
+			heap.erase(end, heap.end());
+			std::make_heap(heap.begin(), heap.end(), heap_compare);
+		}
+
+		if(!cancelled.empty())
+		{
+			std::lock_guard<std::mutex> g(queued_mutex);
+			for(const T& thing : cancelled)
+			{
+				queued.erase(thing);
+			}
 		}
 	}
 
@@ -80,24 +160,135 @@ public:
 		return queued.find(thing) != queued.cend();
 	}
 
+	/**
+	 * Stop giving things to the scheduler and wait for the things being done. Things that are not started are dropped.
+	 */
 	void stop()
 	{
-		if(running)
 		{
+			std::lock_guard<std::mutex> g(things_mutex);
+			if(!running)
+			{
+				return;
+			}
 			running = false;
-			for(auto& thread : threads)
+		}
+		scheduler.remove_source(*this);
+
+		std::unique_lock<std::mutex> lock(things_mutex);
+		idle_cv.wait(lock, [this]()
+		{
+			return active == 0;
+		});
+	}
+
+	bool try_take(job_scheduler::job_t& job) override
+	{
+		std::vector<T> batch;
+		{
+			std::lock_guard<std::mutex> g(things_mutex);
+			const std::size_t pending = (priority == nullptr) ? fifo.size() : heap.size();
+			if(!running || pending == 0)
 			{
-				thread.join();
+				return false;
 			}
+
+			// a few things at a time to lock less often, but not so many that the other threads have nothing to do
+			const std::size_t count = std::clamp<std::size_t>(pending / scheduler.thread_count(), 1, max_batch_size);
+			for(std::size_t i = 0; i < count; ++i)
+			{
+				if(priority == nullptr)
+				{
+					batch.emplace_back(std::move(fifo.front()));
+					fifo.pop_front();
+				}
+				else
+				{
+					std::pop_heap(heap.begin(), heap.end(), heap_compare);
+					batch.emplace_back(std::move(heap.back().second));
+					heap.pop_back();
+				}
+			}
+			++active;
 		}
+
+		job = [this, batch = std::move(batch)]() mutable
+		{
+			// declared first, so it is destroyed last, even if something below throws
+			active_guard g(*this);
+			for(T& thing : batch)
+			{
+				try
+				{
+					f(thing);
+				}
+				catch(const std::exception& e)
+				{
+					// the rest of the batch is still done, and the failed thing is forgotten so that it can be enqueued again
+					LOG(ERROR) << "error in a job: " << e.what() << '\n';
+					forget(thing);
+				}
+			}
+		};
+		return true;
 	}
 
 private:
-	moodycamel::ConcurrentQueue<T> things;
+	static constexpr std::size_t max_batch_size = 8;
+
+	// marks a taken batch as done when it is destroyed
+	struct active_guard
+	{
+		explicit active_guard(ThreadThingy& t)
+		:
+			t(t)
+		{
+		}
+
+		~active_guard()
+		{
+			// notify while locked, since stop can return (and t can be destroyed) as soon as the lock is released
+			std::lock_guard<std::mutex> g(t.things_mutex);
+			--t.active;
+			t.idle_cv.notify_all();
+		}
+
+		active_guard(active_guard&&) = delete;
+		active_guard(const active_guard&) = delete;
+		active_guard& operator=(active_guard&&) = delete;
+		active_guard& operator=(const active_guard&) = delete;
+
+		ThreadThingy& t;
+	};
+
+	// unlike dequeue, the thing does not need to be queued (f might have dequeued it before throwing)
+	void forget(const T& thing)
+	{
+		std::lock_guard<std::mutex> g(queued_mutex);
+		queued.erase(thing);
+	}
+
+	// std::push_heap makes a max heap, so this puts the lowest priority on top
+	static bool heap_compare(const std::pair<priority_t, T>& a, const std::pair<priority_t, T>& b)
+	{
+		return a.first > b.first;
+	}
+
+	std::function<void(T&)> f;
+	job_scheduler& scheduler;
+	priority_func_t priority;
+
+	// things to do: fifo is used without a priority function, and heap with one
+	std::deque<T> fifo;
+	std::vector<std::pair<priority_t, T>> heap;
+	bool running;
+	std::size_t active; // batches being done
+	std::mutex things_mutex;
+	std::condition_variable idle_cv;
+
+	// things that are enqueued and not yet dequeued by the user, for ignoring duplicates
 	std::unordered_set<T, Hash> queued;
 	mutable std::mutex queued_mutex;
-	std::atomic<bool> running;
-	std::vector<std::thread> threads;
 };
 
 }
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "util/epoch.hpp"
+
+namespace block_thingy::util {
+
+/**
+ * A hash map that many threads can read while one or more threads write.
+ *
+ * The map is split into shards by the high bits of the hash. Each shard is an
+ * immutable open-addressing table: a writer copies the table of its shard with
+ * the change made, then publishes the copy. Reads do not lock; the old table
+ * is freed through util::epoch once no reader can see it.
+ *
+ * This suits maps that are read much more often than they are written, such as
+ * the chunks of a world. The hash needs good high and low bits, since the high
+ * bits pick the shard and the low bits pick the slot.
+ */
+template
+<
+	typename K,
+	typename V,
+	typename Hash
+>
+class concurrent_map
+{
+public:
+	explicit concurrent_map(const Hash& hash = Hash())
+	:
+		hash(hash)
+	{
+		for(shard& s : shards)
+		{
+			s.table.store(new table_t(0), std::memory_order_relaxed);
+		}
+	}
+
+	~concurrent_map()
+	{
+		// nothing can be reading while the map is destroyed
+		for(shard& s : shards)
+		{
+			delete s.table.load(std::memory_order_relaxed);
+		}
+	}
+
+	concurrent_map(concurrent_map&&) = delete;
+	concurrent_map(const concurrent_map&) = delete;
+	concurrent_map& operator=(concurrent_map&&) = delete;
+	concurrent_map& operator=(const concurrent_map&) = delete;
+
+	/**
+	 * @return The value of the key, or a default value (such as null) if it is not in the map
+	 */
+	V get(const K& key) const
+	{
+		const uint64_t h = hash(key);
+		util::epoch::guard g;
+		const table_t* t = get_shard(h).table.load(std::memory_order_acquire);
+		const std::optional<std::size_t> i = t->find(key, h);
+		if(i == std::nullopt)
+		{
+			return V();
+		}
+		return t->slots[*i]->second;
+	}
+
+	bool has(const K& key) const
+	{
+		const uint64_t h = hash(key);
+		util::epoch::guard g;
+		return get_shard(h).table.load(std::memory_order_acquire)->find(key, h) != std::nullopt;
+	}
+
+	/**
+	 * Add or replace the value of a key
+	 *
+	 * @return The old value, or a default value if the key was not in the map
+	 */
+	V set(const K& key, V value)
+	{
+		const uint64_t h = hash(key);
+		shard& s = get_shard(h);
+		std::lock_guard<std::mutex> g(s.write_mutex);
+		const table_t* old_table = s.table.load(std::memory_order_relaxed);
+		const std::optional<std::size_t> i = old_table->find(key, h);
+
+		V old_value;
+		auto new_table = std::make_unique<table_t>(old_table->size + (i == std::nullopt ? 1 : 0));
+		for(const auto& slot : old_table->slots)
+		{
+			if(slot == std::nullopt)
+			{
+				continue;
+			}
+			if(i != std::nullopt && slot->first == key)
+			{
+				old_value = slot->second;
+				continue;
+			}
+			new_table->insert(slot->first, slot->second, hash(slot->first));
+		}
+		new_table->insert(key, std::move(value), h);
+		publish(s, new_table.release());
+		return old_value;
+	}
+
+	/**
+	 * @return The old value, or a default value if the key was not in the map
+	 */
+	V erase(const K& key)
+	{
+		const uint64_t h = hash(key);
+		shard& s = get_shard(h);
+		std::lock_guard<std::mutex> g(s.write_mutex);
+		const table_t* old_table = s.table.load(std::memory_order_relaxed);
+		const std::optional<std::size_t> i = old_table->find(key, h);
+		if(i == std::nullopt)
+		{
+			return V();
+		}
+
+		V old_value = old_table->slots[*i]->second;
+		auto new_table = std::make_unique<table_t>(old_table->size - 1);
+		for(const auto& slot : old_table->slots)
+		{
+			if(slot != std::nullopt && !(slot->first == key))
+			{
+				new_table->insert(slot->first, slot->second, hash(slot->first));
+			}
+		}
+		publish(s, new_table.release());
+		return old_value;
+	}
+
+	/**
+	 * Call `f(key, value)` for every entry. Each shard is seen as it was at one time, but writes to other shards can be seen or not.
+	 * The entries are copied first and `f` is called after the epoch guard is dropped, so `f` can be slow and can use the map.
+	 */
+	template<typename F>
+	void for_each(F&& f) const
+	{
+		std::vector<std::pair<K, V>> entries;
+		{
+			util::epoch::guard g;
+			for(const shard& s : shards)
+			{
+				const table_t* t = s.table.load(std::memory_order_acquire);
+				for(const auto& slot : t->slots)
+				{
+					if(slot != std::nullopt)
+					{
+						entries.emplace_back(*slot);
+					}
+				}
+			}
+		}
+		for(const auto& entry : entries)
+		{
+			f(entry.first, entry.second);
+		}
+	}
+
+	std::size_t size() const
+	{
+		std::size_t size = 0;
+		util::epoch::guard g;
+		for(const shard& s : shards)
+		{
+			size += s.table.load(std::memory_order_acquire)->size;
+		}
+		return size;
+	}
+
+private:
+	static constexpr std::size_t shard_bits = 6;
+
+	struct table_t
+	{
+		// at most half full, so a search ends soon at an empty slot
+		explicit table_t(const std::size_t size)
+		:
+			size(size),
+			mask(capacity(size) - 1),
+			slots(capacity(size))
+		{
+		}
+
+		static std::size_t capacity(const std::size_t size)
+		{
+			std::size_t capacity = 4;
+			while(capacity < size * 2)
+			{
+				capacity *= 2;
+			}
+			return capacity;
+		}
+
+		std::optional<std::size_t> find(const K& key, const uint64_t h) const
+		{
+			for(std::size_t i = h & mask;; i = (i + 1) & mask)
+			{
+				if(slots[i] == std::nullopt)
+				{
+					return std::nullopt;
+				}
+				if(slots[i]->first == key)
+				{
+					return i;
+				}
+			}
+		}
+
+		// only used while the table is built, before it is published
+		void insert(const K& key, V value, const uint64_t h)
+		{
+			std::size_t i = h & mask;
+			while(slots[i] != std::nullopt)
+			{
+				i = (i + 1) & mask;
+			}
+			slots[i].emplace(key, std::move(value));
+		}
+
+		const std::size_t size;
+		const std::size_t mask;
+		std::vector<std::optional<std::pair<K, V>>> slots;
+	};
+
+	struct shard
+	{
+		std::atomic<const table_t*> table;
+		std::mutex write_mutex;
+	};
+
+	shard& get_shard(const uint64_t h)
+	{
+		return shards[h >> (64 - shard_bits)];
+	}
+	const shard& get_shard(const uint64_t h) const
+	{
+		return shards[h >> (64 - shard_bits)];
+	}
+
+	static void publish(shard& s, const table_t* new_table)
+	{
+		const table_t* old_table = s.table.exchange(new_table, std::memory_order_acq_rel);
+		util::epoch::retire([old_table]()
+		{
+			delete old_table;
+		});
+	}
+
+	Hash hash;
+	std::array<shard, std::size_t(1) << shard_bits> shards;
+};
+
+}
@@ -0,0 +1,75 @@
+#include "decompress.hpp"
+
+#include <stdexcept>
+#include <stdint.h>
+
+#include <zlib.h>
+
+using std::string;
+
+namespace block_thingy::util {
+
+string decompress(const char* data, const std::size_t size)
+{
+	const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+
+	string out;
+	// a gzip member is at least 18 bytes, and ends with the decompressed size (mod 2^32)
+	if(size >= 18 && bytes[0] == 0x1F && bytes[1] == 0x8B)
+	{
+		const unsigned char* s = bytes + size - 4;
+		const uint32_t decompressed_size = static_cast<uint32_t>(s[0])
+			| static_cast<uint32_t>(s[1]) << 8
+			| static_cast<uint32_t>(s[2]) << 16
+			| static_cast<uint32_t>(s[3]) << 24;
+		// deflate can not compress more than about 1032:1, so a bigger size is from bad data and is not trusted
+		if(decompressed_size <= size * 1032)
+		{
+			out.resize(decompressed_size);
+		}
+	}
+	if(out.empty())
+	{
+		out.resize(size * 4 + 64);
+	}
+
+	z_stream zs{};
+	// zlib does not write to the input
+	zs.next_in = const_cast<Bytef*>(bytes);
+	zs.avail_in = static_cast<uInt>(size);
+	// 32: detect gzip or zlib from the header
+	if(inflateInit2(&zs, 15 + 32) != Z_OK)
+	{
+		throw std::runtime_error("error starting zlib");
+	}
+
+	std::size_t produced = 0;
+	while(true)
+	{
+		if(produced == out.size())
+		{
+			out.resize(out.size() * 2);
+		}
+		zs.next_out = reinterpret_cast<Bytef*>(&out[produced]);
+		zs.avail_out = static_cast<uInt>(out.size() - produced);
+		const int result = inflate(&zs, Z_NO_FLUSH);
+		produced = out.size() - zs.avail_out;
+		if(result == Z_STREAM_END)
+		{
+			break;
+		}
+		// Z_BUF_ERROR with output space left means the input ended early
+		if(result != Z_OK && !(result == Z_BUF_ERROR && zs.avail_out == 0))
+		{
+			const string message = (zs.msg != nullptr) ? zs.msg : "data is truncated";
+			inflateEnd(&zs);
+			throw std::runtime_error("error decompressing: " + message);
+		}
+	}
+	inflateEnd(&zs);
+
+	out.resize(produced);
+	return out;
+}
+
+}
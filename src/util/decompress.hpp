@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace block_thingy::util {
+
+/**
+ * Decompress gzip or zlib data in one pass. For gzip, the size stored at the end is used to allocate the output once.
+ *
+ * @throws std::runtime_error if the data is not valid or is truncated
+ */
+std::string decompress(const char* data, std::size_t size);
+
+}
@@ -0,0 +1,178 @@
+#include "epoch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace block_thingy::util::epoch {
+
+// see https://www.cl.cam.ac.uk/techreports/UCAM-CL-TR-579.pdf (section 5.2.3)
+
+constexpr std::size_t max_threads = 256;
+
+struct alignas(64) thread_slot
+{
+	std::atomic<bool> used{false};
+
+	// 0 if the thread is not reading, otherwise the global epoch from when it started reading
+	std::atomic<uint64_t> epoch{0};
+};
+
+struct retired_t
+{
+	uint64_t epoch;
+	std::function<void()> deleter;
+};
+
+struct state_t
+{
+	state_t()
+	:
+		global_epoch(1)
+	{
+	}
+
+	~state_t()
+	{
+		// there are no readers during static destruction
+		for(retired_t& r : retired)
+		{
+			r.deleter();
+		}
+	}
+
+	std::atomic<uint64_t> global_epoch;
+	std::array<thread_slot, max_threads> slots;
+
+	std::vector<retired_t> retired;
+	std::mutex retired_mutex;
+
+	// must be called with retired_mutex locked
+	void try_advance()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const uint64_t e = global_epoch.load(std::memory_order_relaxed);
+		for(const thread_slot& slot : slots)
+		{
+			if(!slot.used.load(std::memory_order_relaxed))
+			{
+				continue;
+			}
+			const uint64_t slot_epoch = slot.epoch.load(std::memory_order_relaxed);
+			if(slot_epoch != 0 && slot_epoch != e)
+			{
+				return;
+			}
+		}
+		global_epoch.store(e + 1, std::memory_order_release);
+	}
+};
+
+static state_t& get_state()
+{
+	static state_t state;
+	return state;
+}
+
+struct registration
+{
+	registration()
+	:
+		slot(nullptr),
+		depth(0)
+	{
+		for(thread_slot& s : get_state().slots)
+		{
+			bool expected = false;
+			if(s.used.compare_exchange_strong(expected, true))
+			{
+				slot = &s;
+				return;
+			}
+		}
+		throw std::runtime_error("util::epoch: more than " + std::to_string(max_threads) + " threads are reading");
+	}
+
+	~registration()
+	{
+		slot->epoch.store(0, std::memory_order_release);
+		slot->used.store(false, std::memory_order_release);
+	}
+
+	registration(registration&&) = delete;
+	registration(const registration&) = delete;
+	registration& operator=(registration&&) = delete;
+	registration& operator=(const registration&) = delete;
+
+	thread_slot* slot;
+	std::size_t depth;
+};
+
+static registration& this_thread()
+{
+	thread_local registration r;
+	return r;
+}
+
+guard::guard()
+{
+	registration& r = this_thread();
+	if(r.depth++ == 0)
+	{
+		r.slot->epoch.store(get_state().global_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+		// the announcement must be visible before any shared data is loaded
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+guard::~guard()
+{
+	registration& r = this_thread();
+	if(--r.depth == 0)
+	{
+		r.slot->epoch.store(0, std::memory_order_release);
+	}
+}
+
+void retire(std::function<void()> deleter)
+{
+	state_t& state = get_state();
+
+	std::vector<std::function<void()>> to_delete;
+	{
+		std::lock_guard<std::mutex> g(state.retired_mutex);
+
+		// the data was unlinked before this, so no reader that starts after this epoch can reach it
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		state.retired.push_back({state.global_epoch.load(std::memory_order_relaxed), std::move(deleter)});
+
+		state.try_advance();
+
+		// readers pinned at epoch e can still see data retired at e, and the global epoch only advances
+		// when every reader is at the current one, so data retired at e is unreachable at e + 2
+		const uint64_t e = state.global_epoch.load(std::memory_order_relaxed);
+		const auto i = std::partition(state.retired.begin(), state.retired.end(), [e](const retired_t& r)
+		{
+			return r.epoch + 2 > e;
+		});
+		for(auto j = i; j != state.retired.end(); ++j)
+		{
+			to_delete.emplace_back(std::move(j->deleter));
+		}
+		state.retired.erase(i, state.retired.end());
+	}
+
+	for(const auto& f : to_delete)
+	{
+		f();
+	}
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <functional>
+
+namespace block_thingy::util::epoch {
+
+/**
+ * Epoch-based reclamation for data that is read without locking.
+ *
+ * A reader constructs a `guard` before loading shared pointers and keeps it until it is done with the pointed-to data.
+ * A writer unlinks old data so that new readers can not reach it, then passes its deleter to `retire`.
+ * The deleter runs once every reader that could have seen the old data has dropped its guard.
+ *
+ * Guards can be nested; only the outermost one does any synchronization.
+ */
+class guard
+{
+public:
+	guard();
+	~guard();
+
+	guard(guard&&) = delete;
+	guard(const guard&) = delete;
+	guard& operator=(guard&&) = delete;
+	guard& operator=(const guard&) = delete;
+};
+
+void retire(std::function<void()> deleter);
+
+}
@@ -0,0 +1,205 @@
+#include "job_scheduler.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include "util/logger.hpp"
+
+namespace block_thingy::util {
+
+// which scheduler and worker the current thread is, for putting submitted jobs on its own queue
+static thread_local const job_scheduler* current_scheduler = nullptr;
+static thread_local std::size_t current_worker = 0;
+
+job_scheduler::source::~source()
+{
+}
+
+job_scheduler::job_scheduler(const std::size_t thread_count)
+:
+	work_epoch(0),
+	running(true)
+{
+	for(std::size_t i = 0; i < thread_count; ++i)
+	{
+		workers.emplace_back(std::make_unique<worker>());
+	}
+	for(std::size_t i = 0; i < thread_count; ++i)
+	{
+		threads.emplace_back([this, i]()
+		{
+			run(i);
+		});
+	}
+}
+
+job_scheduler::~job_scheduler()
+{
+	stop();
+}
+
+std::size_t job_scheduler::default_thread_count()
+{
+	const unsigned int cores = std::thread::hardware_concurrency();
+	return (cores > 1) ? cores - 1 : 1;
+}
+
+std::size_t job_scheduler::thread_count() const
+{
+	return workers.size();
+}
+
+void job_scheduler::submit(job_t job)
+{
+	if(current_scheduler == this)
+	{
+		worker& w = *workers[current_worker];
+		std::lock_guard<std::mutex> g(w.mutex);
+		w.jobs.emplace_back(std::move(job));
+	}
+	else
+	{
+		std::lock_guard<std::mutex> g(submitted_mutex);
+		submitted.emplace_back(std::move(job));
+	}
+	notify();
+}
+
+void job_scheduler::add_source(source& s, const int rank)
+{
+	{
+		std::unique_lock<std::shared_mutex> g(sources_mutex);
+		const auto i = std::upper_bound(sources.begin(), sources.end(), rank, [](const int rank, const std::pair<int, source*>& p)
+		{
+			return rank < p.first;
+		});
+		sources.emplace(i, rank, &s);
+	}
+	notify();
+}
+
+void job_scheduler::remove_source(source& s)
+{
+	// try_take is called with a shared lock, so this waits for any call in progress
+	std::unique_lock<std::shared_mutex> g(sources_mutex);
+	sources.erase(std::remove_if(sources.begin(), sources.end(), [&s](const std::pair<int, source*>& p)
+	{
+		return p.second == &s;
+	}), sources.end());
+}
+
+void job_scheduler::notify()
+{
+	{
+		std::lock_guard<std::mutex> g(sleep_mutex);
+		++work_epoch;
+	}
+	sleep_cv.notify_one();
+}
+
+void job_scheduler::stop()
+{
+	{
+		std::lock_guard<std::mutex> g(sleep_mutex);
+		if(!running)
+		{
+			return;
+		}
+		running = false;
+	}
+	sleep_cv.notify_all();
+	for(std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void job_scheduler::run(const std::size_t worker_i)
+{
+	current_scheduler = this;
+	current_worker = worker_i;
+
+	while(true)
+	{
+		// read before looking, so that work added while looking is not slept through
+		const uint64_t epoch = work_epoch;
+		{
+			std::lock_guard<std::mutex> g(sleep_mutex);
+			if(!running)
+			{
+				return;
+			}
+		}
+
+		job_t job;
+		if(find_job(worker_i, job))
+		{
+			try
+			{
+				job();
+			}
+			catch(const std::exception& e)
+			{
+				LOG(ERROR) << "uncaught exception in a job: " << e.what() << '\n';
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleep_cv.wait(lock, [this, epoch]()
+		{
+			return !running || work_epoch != epoch;
+		});
+	}
+}
+
+bool job_scheduler::find_job(const std::size_t worker_i, job_t& job)
+{
+	{
+		worker& w = *workers[worker_i];
+		std::lock_guard<std::mutex> g(w.mutex);
+		if(!w.jobs.empty())
+		{
+			job = std::move(w.jobs.back());
+			w.jobs.pop_back();
+			return true;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> g(submitted_mutex);
+		if(!submitted.empty())
+		{
+			job = std::move(submitted.front());
+			submitted.pop_front();
+			return true;
+		}
+	}
+
+	{
+		std::shared_lock<std::shared_mutex> g(sources_mutex);
+		for(const auto& p : sources)
+		{
+			if(p.second->try_take(job))
+			{
+				return true;
+			}
+		}
+	}
+
+	for(std::size_t i = 1; i < workers.size(); ++i)
+	{
+		worker& victim = *workers[(worker_i + i) % workers.size()];
+		std::lock_guard<std::mutex> g(victim.mutex);
+		if(!victim.jobs.empty())
+		{
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+}
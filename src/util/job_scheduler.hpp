@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace block_thingy::util {
+
+/**
+ * One pool of threads shared by all background work (generating, loading, meshing, and plugins).
+ *
+ * When a thread is free, it runs (in this order):
+ * 1. a job submitted from that thread (newest first)
+ * 2. a job submitted from another thread, such as the main thread (oldest first)
+ * 3. a job from a source (the queue of a stage, such as a `ThreadThingy`), in order of rank
+ * 4. a job stolen from another scheduler thread (oldest first)
+ * If there is nothing to do, it sleeps until a job is submitted or a source calls `notify`.
+ */
+class job_scheduler
+{
+public:
+	using job_t = std::function<void()>;
+
+	class source
+	{
+	public:
+		virtual ~source();
+
+		/**
+		 * Take a job without waiting
+		 *
+		 * @return `false` if there is nothing to do
+		 */
+		virtual bool try_take(job_t&) = 0;
+	};
+
+	explicit job_scheduler(std::size_t thread_count = default_thread_count());
+	~job_scheduler();
+
+	job_scheduler(job_scheduler&&) = delete;
+	job_scheduler(const job_scheduler&) = delete;
+	job_scheduler& operator=(job_scheduler&&) = delete;
+	job_scheduler& operator=(const job_scheduler&) = delete;
+
+	/**
+	 * One thread per core, except the main thread's
+	 */
+	static std::size_t default_thread_count();
+	std::size_t thread_count() const;
+
+	/**
+	 * Run a job on a scheduler thread.
+	 * A job submitted by a job goes on the queue of its thread, where other threads can steal it.
+	 */
+	void submit(job_t);
+
+	/**
+	 * Sources with a lower rank are taken from first.
+	 * A source must be removed before it is destroyed.
+	 */
+	void add_source(source&, int rank);
+
+	/**
+	 * After this returns, `try_take` is not called on the source again (but jobs already taken can still be running)
+	 */
+	void remove_source(source&);
+
+	/**
+	 * Wake a sleeping thread; a source calls this after it gets a job
+	 */
+	void notify();
+
+	/**
+	 * Wait for the threads to finish their current jobs. Jobs that are not started are dropped.
+	 */
+	void stop();
+
+private:
+	struct worker
+	{
+		std::deque<job_t> jobs;
+		std::mutex mutex;
+	};
+
+	void run(std::size_t worker_i);
+	bool find_job(std::size_t worker_i, job_t&);
+
+	std::vector<std::unique_ptr<worker>> workers;
+	std::deque<job_t> submitted; // from threads that are not scheduler threads
+	std::mutex submitted_mutex;
+
+	std::vector<std::pair<int, source*>> sources; // sorted by rank
+	std::shared_mutex sources_mutex;
+
+	// incremented when there might be new work, so a thread that found nothing knows whether to sleep
+	std::atomic<uint64_t> work_epoch;
+	bool running;
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+
+	std::vector<std::thread> threads;
+};
+
+}
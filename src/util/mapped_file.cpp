@@ -0,0 +1,116 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef HAVE_POSIX
+	#include <cerrno>
+	#include <cstring>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#elif defined(_WIN32)
+	#include <windows.h>
+#else
+	#include "util/misc.hpp"
+#endif
+
+using std::string;
+
+namespace block_thingy::util {
+
+#if defined(HAVE_POSIX) || defined(_WIN32)
+const bool mapped_file::is_mapping = true;
+#else
+const bool mapped_file::is_mapping = false;
+#endif
+
+mapped_file::mapped_file(const fs::path& path)
+:
+	data_(nullptr),
+	size_(0)
+{
+#ifdef HAVE_POSIX
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		throw std::runtime_error("error opening " + path.u8string() + ": " + std::strerror(errno));
+	}
+	struct stat st;
+	if(fstat(fd, &st) == -1)
+	{
+		const string error = std::strerror(errno);
+		close(fd);
+		throw std::runtime_error("error getting the size of " + path.u8string() + ": " + error);
+	}
+	size_ = static_cast<std::size_t>(st.st_size);
+	if(size_ != 0)
+	{
+		void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+		if(p == MAP_FAILED)
+		{
+			const string error = std::strerror(errno);
+			close(fd);
+			throw std::runtime_error("error mapping " + path.u8string() + ": " + error);
+		}
+		data_ = static_cast<const char*>(p);
+	}
+	// the mapping stays valid after the file is closed
+	close(fd);
+#elif defined(_WIN32)
+	const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("error opening " + path.u8string() + ": error " + std::to_string(GetLastError()));
+	}
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(file, &file_size))
+	{
+		const DWORD error = GetLastError();
+		CloseHandle(file);
+		throw std::runtime_error("error getting the size of " + path.u8string() + ": error " + std::to_string(error));
+	}
+	size_ = static_cast<std::size_t>(file_size.QuadPart);
+	// an empty file can not be mapped
+	if(size_ != 0)
+	{
+		const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* p = (mapping != nullptr) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		const DWORD error = GetLastError();
+		if(mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		if(p == nullptr)
+		{
+			CloseHandle(file);
+			throw std::runtime_error("error mapping " + path.u8string() + ": error " + std::to_string(error));
+		}
+		data_ = static_cast<const char*>(p);
+	}
+	// the view stays valid after the handles are closed
+	CloseHandle(file);
+#else
+	buffer = util::read_file(path);
+	data_ = buffer.data();
+	size_ = buffer.size();
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef HAVE_POSIX
+	if(data_ != nullptr)
+	{
+		munmap(const_cast<char*>(data_), size_);
+	}
+#elif defined(_WIN32)
+	if(data_ != nullptr)
+	{
+		UnmapViewOfFile(data_);
+	}
+#endif
+}
+
+}
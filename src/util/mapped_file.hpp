@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "util/filesystem.hpp"
+
+namespace block_thingy::util {
+
+/**
+ * A read-only view of a whole file. It is mapped into memory on POSIX and Windows, and read into memory otherwise.
+ * The view does not grow with the file; make another one to see what was added.
+ */
+class mapped_file
+{
+public:
+	/**
+	 * `true` where the view is a mapping, which sees changes to the bytes it has, and `false` where it is a copy, which does not
+	 */
+	static const bool is_mapping;
+
+	/**
+	 * @throws std::runtime_error if the file can not be opened or mapped
+	 */
+	explicit mapped_file(const fs::path&);
+	~mapped_file();
+
+	mapped_file(mapped_file&&) = delete;
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(mapped_file&&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	const char* data() const
+	{
+		return data_;
+	}
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+private:
+	const char* data_;
+	std::size_t size_;
+#if !defined(HAVE_POSIX) && !defined(_WIN32)
+	std::string buffer;
+#endif
+};
+
+}
@@ -0,0 +1,217 @@
+#include "heightmap.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+
+#include "position/block_in_chunk.hpp"
+
+namespace block_thingy::world {
+
+using position::block_in_chunk;
+using position::block_in_world;
+using position::chunk_in_world;
+
+static chunk_in_world column_position(chunk_in_world chunk_pos)
+{
+	chunk_pos.y = 0;
+	return chunk_pos;
+}
+
+static std::size_t column_index(const block_in_chunk& pos)
+{
+	return static_cast<std::size_t>(pos.x * CHUNK_SIZE + pos.z);
+}
+
+heightmap::column::column()
+{
+	heights.fill(none);
+}
+
+heightmap::value_type heightmap::get(const value_type x, const value_type z) const
+{
+	const block_in_world block_pos(x, 0, z);
+	std::shared_lock<std::shared_mutex> g(mutex);
+	const auto i = columns.find(column_position(chunk_in_world(block_pos)));
+	if(i == columns.cend())
+	{
+		return none;
+	}
+	return i->second.heights[column_index(block_in_chunk(block_pos))];
+}
+
+chunk_sky_floor_t heightmap::get_sky_floor(const chunk_in_world& chunk_pos) const
+{
+	chunk_sky_floor_t floor;
+	const value_type bottom = chunk_pos.y * CHUNK_SIZE;
+
+	std::shared_lock<std::shared_mutex> g(mutex);
+	const auto i = columns.find(column_position(chunk_pos));
+	if(i == columns.cend())
+	{
+		floor.fill(0);
+		return floor;
+	}
+	for(std::size_t j = 0; j < floor.size(); ++j)
+	{
+		const value_type height = i->second.heights[j];
+		floor[j] = (height == none) ? 0 : static_cast<uint8_t>(std::clamp<value_type>(height + 1 - bottom, 0, CHUNK_SIZE));
+	}
+	return floor;
+}
+
+void heightmap::set_chunk(const chunk_in_world& chunk_pos, const chunk_heightmap_t& chunk_heights, const changed_t& changed)
+{
+	std::vector<change> changes;
+	{
+		std::unique_lock<std::shared_mutex> g(mutex);
+		const chunk_in_world column_pos = column_position(chunk_pos);
+		column& c = columns[column_pos];
+		c.chunks.insert_or_assign(chunk_pos.y, chunk_heights);
+		for(std::size_t i = 0; i < c.heights.size(); ++i)
+		{
+			update(c, column_pos, i, changes, chunk_pos.y);
+		}
+	}
+	for(const change& ch : changes)
+	{
+		changed(ch.x, ch.z, ch.y_min, ch.y_max);
+	}
+}
+
+void heightmap::remove_chunk(const chunk_in_world& chunk_pos, const changed_t& changed)
+{
+	std::vector<change> changes;
+	{
+		std::unique_lock<std::shared_mutex> g(mutex);
+		const chunk_in_world column_pos = column_position(chunk_pos);
+		const auto it = columns.find(column_pos);
+		if(it == columns.cend() || it->second.chunks.erase(chunk_pos.y) == 0)
+		{
+			return;
+		}
+		column& c = it->second;
+		if(c.chunks.empty())
+		{
+			// nothing is left for the sky to reach
+			columns.erase(it);
+			return;
+		}
+		for(std::size_t i = 0; i < c.heights.size(); ++i)
+		{
+			update(c, column_pos, i, changes, std::nullopt);
+		}
+	}
+	for(const change& ch : changes)
+	{
+		changed(ch.x, ch.z, ch.y_min, ch.y_max);
+	}
+}
+
+void heightmap::unload_chunk(const chunk_in_world& chunk_pos)
+{
+	std::unique_lock<std::shared_mutex> g(mutex);
+	const auto it = columns.find(column_position(chunk_pos));
+	if(it == columns.cend())
+	{
+		return;
+	}
+	column& c = it->second;
+	const auto chunk_it = c.chunks.find(chunk_pos.y);
+	if(chunk_it == c.chunks.cend())
+	{
+		return;
+	}
+	const chunk_heightmap_t& heights = chunk_it->second;
+	if(std::all_of(heights.cbegin(), heights.cend(), [](const int8_t top) { return top < 0; }))
+	{
+		c.chunks.erase(chunk_it);
+		if(c.chunks.empty())
+		{
+			columns.erase(it);
+		}
+	}
+}
+
+void heightmap::set_column
+(
+	const chunk_in_world& chunk_pos,
+	const chunk_heightmap_t& chunk_heights,
+	const block_in_chunk& pos,
+	const changed_t& changed
+)
+{
+	std::vector<change> changes;
+	{
+		std::unique_lock<std::shared_mutex> g(mutex);
+		const chunk_in_world column_pos = column_position(chunk_pos);
+		const auto it = columns.find(column_pos);
+		if(it == columns.cend())
+		{
+			return;
+		}
+		column& c = it->second;
+		const auto chunk_it = c.chunks.find(chunk_pos.y);
+		if(chunk_it == c.chunks.cend())
+		{
+			return;
+		}
+		const std::size_t i = column_index(pos);
+		chunk_it->second[i] = chunk_heights[i];
+		update(c, column_pos, i, changes, std::nullopt);
+	}
+	for(const change& ch : changes)
+	{
+		changed(ch.x, ch.z, ch.y_min, ch.y_max);
+	}
+}
+
+void heightmap::update
+(
+	column& c,
+	const chunk_in_world& column_pos,
+	const std::size_t i,
+	std::vector<change>& changes,
+	const std::optional<chunk_in_world::value_type> skip_chunk_y
+)
+{
+	// the highest chunk with an opaque block in this column has the height
+	value_type height = none;
+	for(auto it = c.chunks.crbegin(); it != c.chunks.crend(); ++it)
+	{
+		const int8_t top = it->second[i];
+		if(top >= 0)
+		{
+			height = it->first * CHUNK_SIZE + top;
+			break;
+		}
+	}
+	const value_type old_height = c.heights[i];
+	if(height == old_height)
+	{
+		return;
+	}
+	c.heights[i] = height;
+
+	// the blocks between the old and new heights (and the top one) started or stopped being reached
+	const value_type low = std::min(height, old_height);
+	value_type y_min = (low == none) ? c.chunks.cbegin()->first * CHUNK_SIZE : low + 1;
+	value_type y_max = std::max(height, old_height);
+	if(skip_chunk_y != std::nullopt)
+	{
+		// the blocks of an added chunk are lit when it is added
+		y_max = std::min(y_max, *skip_chunk_y * CHUNK_SIZE - 1);
+	}
+	if(y_min > y_max)
+	{
+		return;
+	}
+
+	const block_in_world corner(column_pos, {0, 0, 0});
+	const value_type x = corner.x + static_cast<value_type>(i) / CHUNK_SIZE;
+	const value_type z = corner.z + static_cast<value_type>(i) % CHUNK_SIZE;
+	changes.push_back({x, z, y_min, y_max});
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include "chunk/Chunk.hpp"
+#include "fwd/position/block_in_chunk.hpp"
+#include "position/block_in_world.hpp"
+#include "position/chunk_in_world.hpp"
+#include "position/hash.hpp"
+
+namespace block_thingy::world {
+
+/**
+ * The highest opaque block of each column of blocks, from the heightmaps of the chunks in the world
+ * and of the unloaded chunks that had opaque blocks.
+ * Everything above it is lit by the sky, so sky light there is known without reading any chunk,
+ * and sky light only has to be spread below it (such as under overhangs).
+ *
+ * The world changes it on the main thread, and light jobs read it.
+ */
+class heightmap
+{
+public:
+	using value_type = position::block_in_world::value_type;
+
+	/**
+	 * The height of a column that has no opaque block in the chunks of the world
+	 */
+	static constexpr value_type none = std::numeric_limits<value_type>::min();
+
+	/**
+	 * Called with each column whose height changed, and the lowest and highest y of the blocks
+	 * (in the chunks of the world) that the sky started or stopped reaching
+	 */
+	using changed_t = std::function<void(value_type x, value_type z, value_type y_min, value_type y_max)>;
+
+	/**
+	 * @return The y of the highest opaque block at (x, z), or `none`
+	 */
+	value_type get(value_type x, value_type z) const;
+
+	/**
+	 * @return Where the sky reaches in each column of a chunk
+	 */
+	chunk_sky_floor_t get_sky_floor(const position::chunk_in_world&) const;
+
+	/**
+	 * Add or replace the heightmap of a chunk.
+	 * The blocks of the chunk itself are not given to `changed`, since it is lit by itself when it is added.
+	 */
+	void set_chunk(const position::chunk_in_world&, const chunk_heightmap_t&, const changed_t&);
+
+	void remove_chunk(const position::chunk_in_world&, const changed_t&);
+
+	/**
+	 * For a chunk that is unloaded but still saved: its blocks still stop the sky, so its heights are kept
+	 * (unless it has no opaque block, in which case it does not change any height and is dropped).
+	 * The heights stay the same, so nothing is relit.
+	 */
+	void unload_chunk(const position::chunk_in_world&);
+
+	/**
+	 * Update a column of a chunk after a block in it changed
+	 */
+	void set_column(const position::chunk_in_world&, const chunk_heightmap_t&, const position::block_in_chunk&, const changed_t&);
+
+private:
+	struct column
+	{
+		column();
+
+		std::map<position::chunk_in_world::value_type, chunk_heightmap_t> chunks; // by chunk y
+		std::array<value_type, CHUNK_SIZE * CHUNK_SIZE> heights;
+	};
+
+	// a change found while locked, given to `changed` after unlocking
+	struct change
+	{
+		value_type x, z, y_min, y_max;
+	};
+
+	// find the height of a column of blocks again, and add a change if it is different
+	static void update
+	(
+		column&,
+		const position::chunk_in_world& column_pos,
+		std::size_t i,
+		std::vector<change>&,
+		std::optional<position::chunk_in_world::value_type> skip_chunk_y
+	);
+
+	// columns are by the position of their chunk at y 0
+	position::unordered_map_t<position::chunk_in_world, column> columns;
+	mutable std::shared_mutex mutex;
+};
+
+}
@@ -0,0 +1,1022 @@
+#include "light_engine.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <iterator>
+#include <optional>
+
+#include <glm/vec3.hpp>
+
+#include "block/base.hpp"
+#include "chunk/Chunk.hpp"
+#include "position/block_in_chunk.hpp"
+#include "util/logger.hpp"
+#include "world/heightmap.hpp"
+#include "world/world.hpp"
+
+using std::shared_ptr;
+
+namespace block_thingy::world {
+
+using position::block_in_chunk;
+using position::block_in_world;
+using position::chunk_in_world;
+
+// a queue entry is a chunk slot and a block index in one number
+constexpr uint32_t index_bits = 15;
+static_assert(CHUNK_BLOCK_COUNT <= (1 << index_bits), "a block index must fit in index_bits");
+constexpr uint32_t index_mask = (1u << index_bits) - 1;
+constexpr uint32_t max_slots = 1u << (32 - index_bits);
+constexpr uint32_t chunk_size = static_cast<uint32_t>(CHUNK_SIZE);
+constexpr uint32_t block_count = static_cast<uint32_t>(CHUNK_BLOCK_COUNT);
+
+static uint32_t pack(const uint32_t slot, const uint32_t i)
+{
+	return (slot << index_bits) | i;
+}
+
+// neighbor slots that are not looked up yet, or have no chunk
+constexpr uint32_t unresolved = ~uint32_t(0);
+constexpr uint32_t missing = ~uint32_t(0) - 1;
+
+// a direction is the same as block::enums::Face (axis * 2, plus 1 if negative), so dir ^ 1 is the opposite direction
+// the strides are the same as the block order of ChunkData (x major, z minor)
+constexpr std::array<uint32_t, 3> strides
+{{
+	chunk_size * chunk_size,
+	chunk_size,
+	1,
+}};
+
+static glm::ivec3 dir_to_vec(const uint8_t dir)
+{
+	glm::ivec3 v(0);
+	v[dir / 2] = (dir % 2 == 0) ? 1 : -1;
+	return v;
+}
+
+// call f with the index of each block on the side of a chunk that faces a direction
+template<typename F>
+static void for_side(const uint8_t dir, F f)
+{
+	const uint8_t axis = dir / 2;
+	const uint32_t stride_a = strides[(axis + 1) % 3];
+	const uint32_t stride_b = strides[(axis + 2) % 3];
+	const uint32_t base = (dir % 2 == 0) ? (chunk_size - 1) * strides[axis] : 0;
+	for(uint32_t a = 0; a < chunk_size; ++a)
+	for(uint32_t b = 0; b < chunk_size; ++b)
+	{
+		f(base + a * stride_a + b * stride_b);
+	}
+}
+
+// a job takes a few requests at a time, since every chunk it touches takes about 100 KB
+constexpr std::size_t max_requests = 16;
+
+// the column of a block index, in the order of chunk_sky_floor_t
+static uint32_t column_of(const uint32_t i)
+{
+	return i / strides[0] * chunk_size + i % chunk_size;
+}
+
+struct light_engine::light_chunk
+{
+	void load(shared_ptr<Chunk> new_chunk, const chunk_sky_floor_t& new_sky_floor)
+	{
+		chunk = std::move(new_chunk);
+		position = chunk->get_position();
+		sky_floor = new_sky_floor;
+
+		const auto light_copy = chunk->copy_blocklight();
+		const auto sky_copy = chunk->copy_skylight();
+		for(std::size_t i = 0; i < light.size(); ++i)
+		{
+			const graphics::color color = light_copy[i];
+			light[i] = {color.r, color.g, color.b, sky_copy[i]};
+		}
+
+		chunk_blocks_t::snapshot blocks = chunk->copy_blocks();
+		block_indexes = std::move(blocks.indices);
+		filters.clear();
+		emits.clear();
+		emits_any = false;
+		for(const shared_ptr<block::base>& block : blocks.palette)
+		{
+			// empty palette slots are not used by any block
+			const graphics::color f = block != nullptr ? filter(*block) : graphics::color(0);
+			const graphics::color e = block != nullptr ? block->light() : graphics::color(0);
+			// sky light is white, so it gets through a block that lets any color through
+			filters.push_back({f.r, f.g, f.b, std::max({f.r, f.g, f.b})});
+			emits.push_back({e.r, e.g, e.b, 0});
+			emits_any = emits_any || e != 0;
+		}
+
+		neighbors.fill(unresolved);
+		changed.clear();
+		changed_bits.reset();
+		sky_filled = false;
+		added = false;
+	}
+
+	std::size_t block_at(const uint32_t i) const
+	{
+		return block_indexes.empty() ? 0 : block_indexes[i];
+	}
+
+	bool sky_reaches(const uint32_t i) const
+	{
+		return i / strides[1] % chunk_size >= sky_floor[column_of(i)];
+	}
+
+	// the light a block makes, with all of the sky light if the sky reaches it
+	value_t emit(const uint32_t i) const
+	{
+		value_t e = emits[block_at(i)];
+		if(sky_reaches(i))
+		{
+			e[sky] = graphics::color::max;
+		}
+		return e;
+	}
+
+	shared_ptr<Chunk> chunk;
+	chunk_in_world position;
+	std::array<value_t, CHUNK_BLOCK_COUNT> light;
+	chunk_sky_floor_t sky_floor;
+
+	// the blocks, as indexes into filters and emits
+	std::vector<chunk_blocks_t::palette_index_t> block_indexes; // empty if every block uses index 0
+	std::vector<value_t> filters;
+	std::vector<value_t> emits; // without sky light, since that depends on where the block is
+	bool emits_any;
+
+	std::array<uint32_t, 6> neighbors; // slots, by direction
+
+	std::vector<uint32_t> changed; // block indexes
+	std::bitset<static_cast<std::size_t>(CHUNK_BLOCK_COUNT)> changed_bits;
+	bool sky_filled;
+	bool added;
+};
+
+light_engine::light_engine
+(
+	world& owner,
+	util::job_scheduler& scheduler,
+	const int rank
+)
+:
+	owner(owner),
+	scheduler(scheduler),
+	running(true),
+	active(false),
+	chunk_count(0)
+{
+	scheduler.add_source(*this, rank);
+}
+
+light_engine::~light_engine()
+{
+	stop();
+}
+
+graphics::color light_engine::filter(const block::base& block)
+{
+	if(block.is_opaque())
+	{
+		return {0, 0, 0};
+	}
+	if(block.is_translucent())
+	{
+		return block.light_filter();
+	}
+	return {graphics::color::max, graphics::color::max, graphics::color::max};
+}
+
+void light_engine::update_blocks(std::vector<block_in_world> block_positions)
+{
+	if(block_positions.empty())
+	{
+		return;
+	}
+	enqueue({request::kind_t::update_blocks, std::move(block_positions), std::nullopt, nullptr});
+}
+
+void light_engine::update_block(const block_in_world& block_pos, const graphics::color& light)
+{
+	enqueue({request::kind_t::update_blocks, {block_pos}, light, nullptr});
+}
+
+void light_engine::set_light(const block_in_world& block_pos, const graphics::color& light)
+{
+	enqueue({request::kind_t::set_light, {block_pos}, light, nullptr});
+}
+
+void light_engine::add_chunk(shared_ptr<Chunk> chunk)
+{
+	assert(chunk != nullptr);
+	enqueue({request::kind_t::add_chunk, {}, std::nullopt, std::move(chunk)});
+}
+
+void light_engine::enqueue(request r)
+{
+	{
+		std::lock_guard<std::mutex> g(requests_mutex);
+		if(!running)
+		{
+			return;
+		}
+		requests.emplace_back(std::move(r));
+	}
+	scheduler.notify();
+}
+
+void light_engine::stop()
+{
+	{
+		std::lock_guard<std::mutex> g(requests_mutex);
+		if(!running)
+		{
+			return;
+		}
+		running = false;
+		requests.clear();
+	}
+	scheduler.remove_source(*this);
+
+	std::unique_lock<std::mutex> lock(requests_mutex);
+	idle_cv.wait(lock, [this]()
+	{
+		return !active;
+	});
+}
+
+bool light_engine::try_take(util::job_scheduler::job_t& job)
+{
+	std::vector<request> taken;
+	{
+		std::lock_guard<std::mutex> g(requests_mutex);
+		if(!running || active || requests.empty())
+		{
+			return false;
+		}
+		const std::size_t count = std::min(requests.size(), max_requests);
+		taken.assign(std::make_move_iterator(requests.begin()), std::make_move_iterator(requests.begin() + static_cast<std::ptrdiff_t>(count)));
+		requests.erase(requests.begin(), requests.begin() + static_cast<std::ptrdiff_t>(count));
+		active = true;
+	}
+
+	job = [this, taken = std::move(taken)]() mutable
+	{
+		// ends the job when it is destroyed, even if run throws
+		struct job_guard
+		{
+			light_engine& engine;
+			~job_guard()
+			{
+				engine.end_job();
+			}
+		} g{*this};
+
+		try
+		{
+			run(taken);
+		}
+		catch(const std::exception& e)
+		{
+			// the taken changes are lost, but the next job starts clean
+			LOG(ERROR) << "error spreading light: " << e.what() << '\n';
+			reset();
+		}
+		catch(...)
+		{
+			reset();
+			throw;
+		}
+	};
+	return true;
+}
+
+void light_engine::end_job()
+{
+	bool more;
+	{
+		// notify while locked, since stop can return (and this can be destroyed) as soon as the lock is released
+		std::lock_guard<std::mutex> g(requests_mutex);
+		active = false;
+		more = !requests.empty();
+		idle_cv.notify_all();
+	}
+	if(more)
+	{
+		// the other threads skipped this while the job was active
+		scheduler.notify();
+	}
+}
+
+void light_engine::reset()
+{
+	for(std::size_t slot = 0; slot < chunk_count; ++slot)
+	{
+		chunks[slot]->chunk = nullptr;
+	}
+	chunk_count = 0;
+	slots.clear();
+	add_queue.clear();
+	sub_queue.clear();
+}
+
+void light_engine::publish
+(
+	const std::function<void(const shared_ptr<Chunk>&)>& on_changed,
+	const std::function<void(const shared_ptr<Chunk>&)>& on_lit,
+	const double budget
+)
+{
+	using clock = std::chrono::steady_clock;
+	const clock::time_point start = clock::now();
+	auto out_of_time = [&start, budget]()
+	{
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count() >= budget;
+	};
+
+	light_batch batch;
+	// at least one batch is done each time, so that a small budget still gets through them
+	for(bool first = true; (first || !out_of_time()) && batches.try_dequeue(batch); first = false)
+	{
+		Chunk& chunk = *batch.chunk;
+
+		// the 26 neighbors, looked up when a change on a side needs them
+		std::array<shared_ptr<Chunk>, 27> neighbors;
+		std::bitset<27> looked_up;
+		auto get_neighbor = [&chunk, &neighbors, &looked_up](const glm::ivec3& d) -> Chunk*
+		{
+			const std::size_t n = static_cast<std::size_t>((d.x + 1) * 9 + (d.y + 1) * 3 + (d.z + 1));
+			if(!looked_up[n])
+			{
+				neighbors[n] = chunk.get_neighbor(d);
+				looked_up[n] = true;
+			}
+			return neighbors[n].get();
+		};
+
+		// the light texture of each chunk has a border with the light of its neighbors
+		auto set_neighbor_texbuflight = [&get_neighbor](const glm::ivec3& pos, const graphics::color& color)
+		{
+			glm::ivec3 side;
+			bool on_side = false;
+			for(uint_fast8_t i = 0; i < 3; ++i)
+			{
+				side[i] = (pos[i] == 0) ? -1 : (pos[i] == CHUNK_SIZE - 1) ? 1 : 0;
+				on_side = on_side || side[i] != 0;
+			}
+			if(!on_side)
+			{
+				return;
+			}
+			glm::ivec3 d;
+			for(d.x = -1; d.x <= 1; ++d.x)
+			for(d.y = -1; d.y <= 1; ++d.y)
+			for(d.z = -1; d.z <= 1; ++d.z)
+			{
+				if(d == glm::ivec3(0)
+				|| (d.x != 0 && d.x != side.x)
+				|| (d.y != 0 && d.y != side.y)
+				|| (d.z != 0 && d.z != side.z))
+				{
+					continue;
+				}
+				Chunk* chunk2 = get_neighbor(d);
+				if(chunk2 == nullptr)
+				{
+					continue;
+				}
+				glm::ivec3 pos2;
+				for(uint_fast8_t i = 0; i < 3; ++i)
+				{
+					pos2[i] = (d[i] == 0) ? pos[i] : (d[i] < 0) ? CHUNK_SIZE : -1;
+				}
+				chunk2->set_texbuflight(pos2, color);
+			}
+		};
+
+		for(std::size_t k = 0; k < batch.changes.size(); ++k)
+		{
+			const std::size_t i = batch.changes[k].first;
+			const glm::ivec3 pos
+			(
+				static_cast<int>(i / strides[0]),
+				static_cast<int>(i / strides[1] % chunk_size),
+				static_cast<int>(i % chunk_size)
+			);
+			const graphics::color color = Chunk::mix_light(batch.changes[k].second, batch.sky_changes[k].second);
+			chunk.set_texbuflight(pos, color);
+			set_neighbor_texbuflight(pos, color);
+		}
+		if(!batch.changes.empty())
+		{
+			on_changed(batch.chunk);
+		}
+
+		if(!batch.added)
+		{
+			continue;
+		}
+
+		if(chunk.get_saved_neighbor_stamps() != std::nullopt || batch.sky_filled)
+		{
+			// light that was loaded or filled is not in the changes, so its side still needs to go in the neighbors' textures
+			// (the chunk's own texture is made from its light when it is first drawn, which is after this)
+			const chunk_light_t::snapshot light = chunk.copy_blocklight();
+			const chunk_skylight_t::snapshot sky_light = chunk.copy_skylight();
+			for(uint8_t dir = 0; dir < 6; ++dir)
+			{
+				for_side(dir, [&light, &sky_light, &set_neighbor_texbuflight](const uint32_t i)
+				{
+					const glm::ivec3 pos
+					(
+						static_cast<int>(i / strides[0]),
+						static_cast<int>(i / strides[1] % chunk_size),
+						static_cast<int>(i % chunk_size)
+					);
+					set_neighbor_texbuflight(pos, Chunk::mix_light(light[i], sky_light[i]));
+				});
+			}
+		}
+		on_lit(batch.chunk);
+	}
+}
+
+void light_engine::wait()
+{
+	std::unique_lock<std::mutex> lock(requests_mutex);
+	idle_cv.wait(lock, [this]()
+	{
+		return !running || (!active && requests.empty());
+	});
+}
+
+bool light_engine::idle()
+{
+	std::lock_guard<std::mutex> g(requests_mutex);
+	return !active && requests.empty();
+}
+
+void light_engine::run(std::vector<request>& taken)
+{
+	for(const request& r : taken)
+	{
+		switch(r.kind)
+		{
+			case request::kind_t::update_blocks: do_update_blocks(r); break;
+			case request::kind_t::set_light:     do_set_light(r);     break;
+			case request::kind_t::add_chunk:     do_add_chunk(r);     break;
+		}
+	}
+
+	// write each chunk's changes at once, then give them to publish for the light textures
+	for(std::size_t slot = 0; slot < chunk_count; ++slot)
+	{
+		light_chunk& c = *chunks[slot];
+		if(!c.changed.empty() || c.added)
+		{
+			light_batch batch;
+			batch.chunk = c.chunk;
+			batch.sky_filled = c.sky_filled;
+			batch.added = c.added;
+			batch.changes.reserve(c.changed.size());
+			batch.sky_changes.reserve(c.changed.size());
+			for(const uint32_t i : c.changed)
+			{
+				const value_t& v = c.light[i];
+				batch.changes.emplace_back(i, graphics::color(v[0], v[1], v[2]));
+				batch.sky_changes.emplace_back(i, v[sky]);
+			}
+			if(c.sky_filled)
+			{
+				c.chunk->fill_skylight(graphics::color::max);
+			}
+			c.chunk->set_light(batch.changes, batch.sky_changes);
+			batches.enqueue(std::move(batch));
+		}
+		c.chunk = nullptr;
+	}
+	chunk_count = 0;
+	slots.clear();
+}
+
+void light_engine::do_update_blocks(const request& r)
+{
+	std::vector<uint32_t> positions;
+	positions.reserve(r.block_positions.size());
+	for(const block_in_world& block_pos : r.block_positions)
+	{
+		const uint32_t slot = get_slot(chunk_in_world(block_pos));
+		if(slot == missing)
+		{
+			continue;
+		}
+		const block_in_chunk pos(block_pos);
+		positions.emplace_back(pack(slot, pos.x * strides[0] + pos.y * strides[1] + pos.z));
+	}
+	relight(positions, r.light);
+}
+
+void light_engine::relight(const std::vector<uint32_t>& positions, const std::optional<graphics::color>& block_light)
+{
+	// see https://www.seedofandromeda.com/blogs/29-fast-flood-fill-lighting-in-a-blocky-voxel-game-pt-1
+	// every block is taken away in one pass and spread in one pass, so blocks that are near each other do not spread over the same region again
+	for(const uint32_t p : positions)
+	{
+		const uint32_t slot = p >> index_bits;
+		const uint32_t i = p & index_mask;
+		const value_t old_light = chunks[slot]->light[i];
+		if(old_light != value_t{})
+		{
+			set(slot, i, value_t{});
+			sub_queue.emplace_back(p, old_light);
+		}
+	}
+	spread_sub();
+
+	for(const uint32_t p : positions)
+	{
+		const uint32_t slot = p >> index_bits;
+		const uint32_t i = p & index_mask;
+		light_chunk& c = *chunks[slot];
+		value_t light = c.emit(i);
+		if(block_light != std::nullopt)
+		{
+			for(uint_fast8_t k = 0; k < 3; ++k)
+			{
+				light[k] = (*block_light)[k];
+			}
+		}
+		if(light != value_t{})
+		{
+			// spread_sub can already have put light from another block here
+			value_t color = c.light[i];
+			for(std::size_t k = 0; k < color.size(); ++k)
+			{
+				color[k] = std::max(color[k], light[k]);
+			}
+			set(slot, i, color);
+			seed(slot, i);
+		}
+
+		// light can go through the block now, or a filter changed what it lets through
+		for(uint8_t dir = 0; dir < 6; ++dir)
+		{
+			uint32_t slot2 = slot;
+			uint32_t i2 = i;
+			if(step(slot2, i2, dir))
+			{
+				seed(slot2, i2);
+			}
+		}
+	}
+	spread_add();
+}
+
+void light_engine::do_set_light(const request& r)
+{
+	assert(r.block_positions.size() == 1 && r.light != std::nullopt);
+	const block_in_world& block_pos = r.block_positions[0];
+	const uint32_t slot = get_slot(chunk_in_world(block_pos));
+	if(slot == missing)
+	{
+		return;
+	}
+	const block_in_chunk pos(block_pos);
+	const uint32_t i = pos.x * strides[0] + pos.y * strides[1] + pos.z;
+	value_t light = chunks[slot]->light[i];
+	for(uint_fast8_t k = 0; k < 3; ++k)
+	{
+		light[k] = (*r.light)[k];
+	}
+	set(slot, i, light);
+}
+
+void light_engine::do_add_chunk(const request& r)
+{
+	const chunk_in_world chunk_pos = r.chunk->get_position();
+	if(owner.get_chunk(chunk_pos) != r.chunk)
+	{
+		// replaced or removed before it was lit
+		return;
+	}
+	const uint32_t slot = get_slot(chunk_pos);
+	assert(slot != missing);
+	chunks[slot]->added = true;
+
+	const Chunk& chunk = *chunks[slot]->chunk;
+	const std::optional<std::array<uint64_t, 6>> saved_stamps = chunk.get_saved_neighbor_stamps();
+	if(saved_stamps != std::nullopt)
+	{
+		// loaded with its light, so only the sides against neighbors that changed since it was saved are done
+		const uint64_t stamp = chunk.get_light_stamp();
+		for(uint8_t dir = 0; dir < 6; ++dir)
+		{
+			const uint32_t slot2 = neighbor(slot, dir);
+			if(slot2 == missing)
+			{
+				// it checks this side when it is added
+				continue;
+			}
+			const light_chunk& c2 = *chunks[slot2];
+			const std::optional<std::array<uint64_t, 6>> saved_stamps2 = c2.chunk->get_saved_neighbor_stamps();
+			const bool same
+				=  c2.changed.empty() // its stamp changes at the end of the job
+				&& (*saved_stamps)[dir] == c2.chunk->get_light_stamp()
+				&& (saved_stamps2 == std::nullopt || (*saved_stamps2)[dir ^ 1] == stamp);
+			if(!same)
+			{
+				relight_side(slot, dir);
+			}
+		}
+
+		// the sky can reach more or less of it than when it was saved, such as when a chunk above it was added after it
+		const chunk_sky_floor_t& sky_floor = chunks[slot]->sky_floor;
+		const std::optional<chunk_sky_floor_t> saved_sky_floor = chunk.get_saved_sky_floor();
+		assert(saved_sky_floor != std::nullopt);
+		std::vector<uint32_t> positions;
+		for(uint32_t column = 0; column < sky_floor.size(); ++column)
+		{
+			const uint32_t y_min = std::min(sky_floor[column], (*saved_sky_floor)[column]);
+			const uint32_t y_max = std::max(sky_floor[column], (*saved_sky_floor)[column]);
+			for(uint32_t y = y_min; y < y_max; ++y)
+			{
+				positions.emplace_back(pack(slot, column / chunk_size * strides[0] + y * strides[1] + column % chunk_size));
+			}
+		}
+		if(!positions.empty())
+		{
+			relight(positions, std::nullopt);
+		}
+		return;
+	}
+
+	light_sky(slot);
+
+	// light from its own blocks
+	if(chunks[slot]->emits_any)
+	{
+		for(uint32_t i = 0; i < block_count; ++i)
+		{
+			light_chunk& c = *chunks[slot];
+			const value_t& e = c.emits[c.block_at(i)];
+			if(e != value_t{})
+			{
+				value_t light = c.light[i];
+				for(uint_fast8_t k = 0; k < 3; ++k)
+				{
+					light[k] = std::max(light[k], e[k]);
+				}
+				set(slot, i, light);
+				seed(slot, i);
+			}
+		}
+	}
+
+	// light from the sides of its neighbors
+	for(uint8_t dir = 0; dir < 6; ++dir)
+	{
+		const uint32_t slot2 = neighbor(slot, dir);
+		if(slot2 == missing)
+		{
+			continue;
+		}
+		const light_chunk& c2 = *chunks[slot2];
+		for_side(dir ^ 1, [this, &c2, slot2](const uint32_t i)
+		{
+			if(c2.light[i] != value_t{})
+			{
+				seed(slot2, i);
+			}
+		});
+	}
+	spread_add();
+}
+
+void light_engine::light_sky(const uint32_t slot)
+{
+	light_chunk& c = *chunks[slot];
+	const bool all_sky = std::all_of(c.sky_floor.cbegin(), c.sky_floor.cend(), [](const uint8_t floor)
+	{
+		return floor == 0;
+	});
+	if(all_sky)
+	{
+		// most chunks are all sky or all ground, so this is written to the chunk with one fill instead of a change per block
+		c.sky_filled = true;
+		for(value_t& v : c.light)
+		{
+			v[sky] = graphics::color::max;
+		}
+	}
+	else
+	{
+		for(uint32_t column = 0; column < c.sky_floor.size(); ++column)
+		for(uint32_t y = c.sky_floor[column]; y < chunk_size; ++y)
+		{
+			const uint32_t i = column / chunk_size * strides[0] + y * strides[1] + column % chunk_size;
+			if(c.light[i][sky] != graphics::color::max)
+			{
+				value_t light = c.light[i];
+				light[sky] = graphics::color::max;
+				set(slot, i, light);
+			}
+		}
+	}
+
+	// blocks that the sky reaches only need to spread to the blocks beside them that it does not reach (such as under an overhang)
+	// the blocks above and below them are reached by the sky or are the ground
+	for(const uint8_t dir : {uint8_t(0), uint8_t(1), uint8_t(4), uint8_t(5)})
+	{
+		const uint32_t axis = dir / 2u;
+		const bool positive = (dir % 2 == 0);
+		for(uint32_t column = 0; column < c.sky_floor.size(); ++column)
+		{
+			const uint32_t coord = (axis == 0) ? column / chunk_size : column % chunk_size;
+			const uint32_t column_stride = (axis == 0) ? chunk_size : 1;
+			uint32_t floor2;
+			if(positive ? coord != chunk_size - 1 : coord != 0)
+			{
+				floor2 = c.sky_floor[positive ? column + column_stride : column - column_stride];
+			}
+			else
+			{
+				const uint32_t slot2 = neighbor(slot, dir);
+				if(slot2 == missing)
+				{
+					// it spreads into this when it is added
+					continue;
+				}
+				floor2 = chunks[slot2]->sky_floor[positive ? column - column_stride * (chunk_size - 1) : column + column_stride * (chunk_size - 1)];
+			}
+			for(uint32_t y = c.sky_floor[column]; y < floor2; ++y)
+			{
+				seed(slot, column / chunk_size * strides[0] + y * strides[1] + column % chunk_size);
+			}
+		}
+	}
+}
+
+void light_engine::relight_side(const uint32_t slot, const uint8_t dir)
+{
+	const uint32_t slot2 = neighbor(slot, dir);
+	assert(slot2 != missing);
+
+	// take away the light on both sides, and everything lit through them, then spread back what is left
+	// this also takes away light that one chunk has from the other's old light
+	auto take = [this](const uint32_t slot, const uint8_t dir)
+	{
+		for_side(dir, [this, slot](const uint32_t i)
+		{
+			const value_t color = chunks[slot]->light[i];
+			if(color != value_t{})
+			{
+				set(slot, i, value_t{});
+				sub_queue.emplace_back(pack(slot, i), color);
+			}
+		});
+	};
+	take(slot, dir);
+	take(slot2, dir ^ 1);
+	spread_sub();
+
+	// spread_sub keeps the light of the blocks that make it, except for the blocks it started from
+	auto keep = [this](const uint32_t slot, const uint8_t dir)
+	{
+		for_side(dir, [this, slot](const uint32_t i)
+		{
+			light_chunk& c = *chunks[slot];
+			const value_t emit = c.emit(i);
+			if(emit != value_t{})
+			{
+				value_t color = c.light[i];
+				for(std::size_t k = 0; k < color.size(); ++k)
+				{
+					color[k] = std::max(color[k], emit[k]);
+				}
+				if(color != c.light[i])
+				{
+					set(slot, i, color);
+				}
+			}
+			if(c.light[i] != value_t{})
+			{
+				seed(slot, i);
+			}
+		});
+	};
+	keep(slot, dir);
+	keep(slot2, dir ^ 1);
+	spread_add();
+}
+
+void light_engine::spread_add()
+{
+	// the queue is not popped, so that its memory is reused by the next spread
+	for(std::size_t q = 0; q < add_queue.size(); ++q)
+	{
+		const uint32_t slot = add_queue[q] >> index_bits;
+		const uint32_t i = add_queue[q] & index_mask;
+		value_t color = chunks[slot]->light[i];
+		for(graphics::color::value_type& v : color)
+		{
+			v = (v > 0) ? static_cast<graphics::color::value_type>(v - 1) : 0;
+		}
+		if(color == value_t{})
+		{
+			continue;
+		}
+
+		for(uint8_t dir = 0; dir < 6; ++dir)
+		{
+			uint32_t slot2 = slot;
+			uint32_t i2 = i;
+			if(!step(slot2, i2, dir))
+			{
+				continue;
+			}
+			light_chunk& c2 = *chunks[slot2];
+			const value_t& f = c2.filters[c2.block_at(i2)];
+			value_t color2 = c2.light[i2];
+			bool changed = false;
+			for(std::size_t k = 0; k < color2.size(); ++k)
+			{
+				const graphics::color::value_type v = std::min(color[k], f[k]);
+				if(color2[k] < v)
+				{
+					color2[k] = v;
+					changed = true;
+				}
+			}
+			if(changed)
+			{
+				set(slot2, i2, color2);
+				add_queue.emplace_back(pack(slot2, i2));
+			}
+		}
+	}
+	add_queue.clear();
+}
+
+void light_engine::spread_sub()
+{
+	for(std::size_t q = 0; q < sub_queue.size(); ++q)
+	{
+		const uint32_t slot = sub_queue[q].first >> index_bits;
+		const uint32_t i = sub_queue[q].first & index_mask;
+		const value_t color = sub_queue[q].second;
+
+		for(uint8_t dir = 0; dir < 6; ++dir)
+		{
+			uint32_t slot2 = slot;
+			uint32_t i2 = i;
+			if(!step(slot2, i2, dir))
+			{
+				continue;
+			}
+			light_chunk& c2 = *chunks[slot2];
+			const value_t color2 = c2.light[i2];
+			value_t color_set = color2;
+			value_t color_put{};
+			bool set_it = false;
+			bool spread = false;
+			for(std::size_t k = 0; k < color2.size(); ++k)
+			{
+				if(color2[k] != 0 && color2[k] < color[k])
+				{
+					// this light came from the removed light
+					color_set[k] = 0;
+					color_put[k] = color2[k];
+					set_it = true;
+				}
+				else if(color2[k] != 0 && color2[k] >= color[k])
+				{
+					// this light came from somewhere else, so it fills in what was removed
+					spread = true;
+				}
+			}
+			if(set_it)
+			{
+				// a block that makes light (or that the sky reaches) keeps it
+				const value_t emit = c2.emit(i2);
+				for(std::size_t k = 0; k < emit.size(); ++k)
+				{
+					if(emit[k] > color_set[k])
+					{
+						color_set[k] = emit[k];
+						spread = true;
+					}
+				}
+				set(slot2, i2, color_set);
+				sub_queue.emplace_back(pack(slot2, i2), color_put);
+			}
+			if(spread)
+			{
+				seed(slot2, i2);
+			}
+		}
+	}
+	sub_queue.clear();
+}
+
+uint32_t light_engine::get_slot(const chunk_in_world& chunk_pos)
+{
+	const auto it = slots.find(chunk_pos);
+	if(it != slots.cend())
+	{
+		return it->second;
+	}
+
+	shared_ptr<Chunk> chunk = owner.get_chunk(chunk_pos);
+	if(chunk == nullptr)
+	{
+		return missing;
+	}
+	return add_slot(std::move(chunk));
+}
+
+uint32_t light_engine::add_slot(shared_ptr<Chunk> chunk)
+{
+	assert(chunk_count < max_slots);
+	if(chunk_count == chunks.size())
+	{
+		chunks.emplace_back(std::make_unique<light_chunk>());
+	}
+	const uint32_t slot = static_cast<uint32_t>(chunk_count++);
+	const chunk_in_world chunk_pos = chunk->get_position();
+	chunks[slot]->load(std::move(chunk), owner.get_heightmap().get_sky_floor(chunk_pos));
+	slots.emplace(chunk_pos, slot);
+	return slot;
+}
+
+uint32_t light_engine::neighbor(const uint32_t slot, const uint8_t dir)
+{
+	// the light_chunk does not move when chunks grows, so this stays valid
+	uint32_t& n = chunks[slot]->neighbors[dir];
+	if(n == unresolved)
+	{
+		const glm::ivec3 vec = dir_to_vec(dir);
+		const auto it = slots.find(chunks[slot]->position + chunk_in_world(vec.x, vec.y, vec.z));
+		if(it != slots.cend())
+		{
+			n = it->second;
+		}
+		else
+		{
+			// by the chunk's link, instead of looking it up in the world
+			shared_ptr<Chunk> chunk2 = chunks[slot]->chunk->get_neighbor(vec);
+			n = (chunk2 != nullptr) ? add_slot(std::move(chunk2)) : missing;
+		}
+		if(n != missing)
+		{
+			chunks[n]->neighbors[dir ^ 1] = slot;
+		}
+	}
+	return n;
+}
+
+bool light_engine::step(uint32_t& slot, uint32_t& i, const uint8_t dir)
+{
+	const uint32_t stride = strides[dir / 2];
+	const bool positive = (dir % 2 == 0);
+	const uint32_t coord = i / stride % chunk_size;
+	if(positive ? coord != chunk_size - 1 : coord != 0)
+	{
+		i = positive ? i + stride : i - stride;
+		return true;
+	}
+
+	const uint32_t slot2 = neighbor(slot, dir);
+	if(slot2 == missing)
+	{
+		return false;
+	}
+	slot = slot2;
+	i = positive ? i - stride * (chunk_size - 1) : i + stride * (chunk_size - 1);
+	return true;
+}
+
+void light_engine::set(const uint32_t slot, const uint32_t i, const value_t& color)
+{
+	light_chunk& c = *chunks[slot];
+	c.light[i] = color;
+	if(!c.changed_bits[i])
+	{
+		c.changed_bits[i] = true;
+		c.changed.emplace_back(i);
+	}
+}
+
+void light_engine::seed(const uint32_t slot, const uint32_t i)
+{
+	add_queue.emplace_back(pack(slot, i));
+}
+
+}
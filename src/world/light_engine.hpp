@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <concurrentqueue/concurrentqueue.hpp>
+
+#include "fwd/block/base.hpp"
+#include "fwd/chunk/Chunk.hpp"
+#include "graphics/color.hpp"
+#include "position/block_in_world.hpp"
+#include "position/chunk_in_world.hpp"
+#include "position/hash.hpp"
+#include "util/job_scheduler.hpp"
+#include "fwd/world/world.hpp"
+
+namespace block_thingy::world {
+
+/**
+ * Spreads block light and sky light through the world on the scheduler's threads.
+ *
+ * Changes are queued by the main thread and done a batch at a time by one job.
+ * A job copies the light and blocks of each chunk it touches into arrays of that chunk,
+ * spreads light through the arrays (with queue entries of a chunk slot and a block index),
+ * then writes the changed values to each chunk at once.
+ * Light textures are only used by the main thread, so they are updated by `publish`.
+ *
+ * Sky light is spread the same way as block light, from the blocks above the world's heightmap.
+ * Those blocks all get the most sky light without spreading, so only the ones beside blocks under an overhang spread it.
+ */
+class light_engine : public util::job_scheduler::source
+{
+public:
+	light_engine(world&, util::job_scheduler&, int rank);
+	~light_engine();
+
+	light_engine(light_engine&&) = delete;
+	light_engine(const light_engine&) = delete;
+	light_engine& operator=(light_engine&&) = delete;
+	light_engine& operator=(const light_engine&) = delete;
+
+	/**
+	 * How much of each color a block lets through: none if it is opaque, its filter if it is translucent, and all otherwise
+	 */
+	static graphics::color filter(const block::base&);
+
+	/**
+	 * Relight around blocks whose light or filter changed, or that the sky started or stopped reaching, all in one job
+	 */
+	void update_blocks(std::vector<position::block_in_world>);
+
+	/**
+	 * Relight around a block as if it makes `light`
+	 */
+	void update_block(const position::block_in_world&, const graphics::color& light);
+
+	/**
+	 * Set the light of a block without spreading it
+	 */
+	void set_light(const position::block_in_world&, const graphics::color&);
+
+	/**
+	 * Spread light into a chunk that was put in the world, from its own blocks and from its neighbours
+	 */
+	void add_chunk(std::shared_ptr<Chunk>);
+
+	/**
+	 * Update the light textures with the light changed by finished jobs. Only call this from the main thread.
+	 *
+	 * Chunks that do not fit in the budget are left for the next call.
+	 *
+	 * @param on_changed Called for each chunk whose light changed
+	 * @param on_lit Called for each chunk from `add_chunk` once light has spread into it
+	 * @param budget How long to take, in milliseconds
+	 */
+	void publish
+	(
+		const std::function<void(const std::shared_ptr<Chunk>&)>& on_changed,
+		const std::function<void(const std::shared_ptr<Chunk>&)>& on_lit,
+		double budget
+	);
+
+	/**
+	 * Wait until every queued change is done, such as before saving, so that saved light matches the saved blocks
+	 */
+	void wait();
+
+	/**
+	 * @return `true` if no change is queued or being done, so the light of the chunks will not change until more changes are made
+	 */
+	bool idle();
+
+	/**
+	 * Stop taking changes and wait for the job being done. Changes that are not started are dropped.
+	 */
+	void stop();
+
+	bool try_take(util::job_scheduler::job_t&) override;
+
+private:
+	struct request
+	{
+		enum class kind_t : uint8_t
+		{
+			update_blocks,
+			set_light,
+			add_chunk,
+		};
+		kind_t kind;
+		std::vector<position::block_in_world> block_positions; // for update_blocks and set_light
+		std::optional<graphics::color> light; // for set_light, and update_blocks with a light other than the block's own
+		std::shared_ptr<Chunk> chunk; // for add_chunk
+	};
+	void enqueue(request);
+
+	// the light of a block while a job spreads it: block light (red, green, blue), then sky light
+	using value_t = std::array<graphics::color::value_type, 4>;
+	static constexpr std::size_t sky = 3;
+
+	// a chunk's light and blocks, copied when a job first touches it
+	struct light_chunk;
+
+	// light changed in one chunk by one job
+	struct light_batch
+	{
+		std::shared_ptr<Chunk> chunk;
+		std::vector<std::pair<std::size_t, graphics::color>> changes; // (block index, block light)
+		std::vector<std::pair<std::size_t, graphics::color::value_type>> sky_changes; // (block index, sky light), for the same blocks as changes
+		bool sky_filled; // every block got the most sky light (before the changes), since the sky reaches all of the chunk
+		bool added; // light was spread into it by add_chunk
+	};
+
+	void run(std::vector<request>&);
+	void end_job();
+	// drop the state of a job that failed partway
+	void reset();
+	void do_update_blocks(const request&);
+	void do_set_light(const request&);
+	void do_add_chunk(const request&);
+	void relight(const std::vector<uint32_t>& positions, const std::optional<graphics::color>& light);
+	void light_sky(uint32_t slot);
+	void relight_side(uint32_t slot, uint8_t dir);
+	void spread_add();
+	void spread_sub();
+
+	// these are only used by the job
+	uint32_t get_slot(const position::chunk_in_world&);
+	uint32_t add_slot(std::shared_ptr<Chunk>);
+	uint32_t neighbor(uint32_t slot, uint8_t dir);
+	bool step(uint32_t& slot, uint32_t& i, uint8_t dir);
+	void set(uint32_t slot, uint32_t i, const value_t&);
+	void seed(uint32_t slot, uint32_t i); // queue a block to spread its light
+
+	world& owner;
+	util::job_scheduler& scheduler;
+
+	// taken from the front a few at a time, so a deque, since there can be thousands (such as after teleporting)
+	std::deque<request> requests;
+	bool running;
+	bool active; // a job is being done; one at a time, since jobs change the same chunks
+	std::mutex requests_mutex;
+	std::condition_variable idle_cv;
+
+	std::vector<std::unique_ptr<light_chunk>> chunks; // reused by each job; the first chunk_count are in use
+	std::size_t chunk_count;
+	position::unordered_map_t<position::chunk_in_world, uint32_t> slots;
+	std::vector<uint32_t> add_queue; // chunk slot and block index, packed by `pack`
+	std::vector<std::pair<uint32_t, value_t>> sub_queue; // packed position, and the light to take away
+
+	moodycamel::ConcurrentQueue<light_batch> batches;
+};
+
+}
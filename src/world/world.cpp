@@ -3,32 +3,44 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <limits>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
 #include <stdexcept>
 #include <stdint.h>
-#include <tuple>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
+#include <concurrentqueue/concurrentqueue.hpp>
 #include <glm/common.hpp>
 #include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
 #include <glm/gtc/noise.hpp>
 
 #include "Player.hpp"
 #include "block/base.hpp"
 #include "block/BlockRegistry.hpp"
+#include "block/enums/Face.hpp"
 #include "block/enums/type.hpp"
 #include "chunk/Chunk.hpp"
 #include "chunk/Mesher/Base.hpp"
 #include "graphics/color.hpp"
+#include "graphics/frustum.hpp"
+#include "physics/AABB.hpp"
 #include "position/block_in_chunk.hpp"
 #include "position/block_in_world.hpp"
 #include "position/chunk_in_world.hpp"
 #include "position/hash.hpp"
+#include "settings.hpp"
 #include "storage/world_file.hpp"
+#include "util/concurrent_map.hpp"
+#include "util/job_scheduler.hpp"
 #include "util/ThreadThingy.hpp"
+#include "world/heightmap.hpp"
+#include "world/light_engine.hpp"
 
 using std::string;
 using std::shared_ptr;
@@ -40,12 +52,30 @@ using position::block_in_chunk;
 using position::block_in_world;
 using position::chunk_in_world;
 
+// the scheduler takes jobs from stages with a lower rank first
+// lighting goes first, since new chunks wait for it to be meshed, and it only uses one thread at a time
+// then remeshing, since that is what a player waits for after changing a block
+constexpr int light_rank = 0;
+constexpr int mesh_rank = 1;
+constexpr int load_rank = 2;
+constexpr int gen_rank = 3;
+
+// light textures of chunks that were not drawn for this many ticks are freed
+constexpr uint64_t light_tex_keep_ticks = 5 * 60;
+// how often to free light textures, unload chunks, and ask again for the neighbours that lit chunks wait for
+constexpr uint64_t sweep_ticks = 60;
+// while the camera stays in the same chunk, the jobs are only sorted again this often, so that turning still moves the frustum's chunks ahead
+constexpr uint64_t reprioritize_calls = 30;
+
+static block_in_world::value_type terrain_height(block_in_world::value_type x, block_in_world::value_type z);
+
 struct world::impl
 {
 	impl
 	(
 		world& world,
-		const fs::path& file_path
+		const fs::path& file_path,
+		util::job_scheduler& job_scheduler
 	)
 	:
 		world(world),
@@ -55,49 +85,126 @@ struct world::impl
 			shared_ptr<Chunk> chunk = std::make_shared<Chunk>(pos, world);
 			gen_chunk(chunk);
 			generated_chunks.enqueue(chunk);
-		}, 2, position::hasher<chunk_in_world>),
+		}, job_scheduler, gen_rank, position::hasher<chunk_in_world>, [this](const chunk_in_world& pos)
+		{
+			return job_priority(pos);
+		}),
 		load_thread([this](const chunk_in_world& pos)
 		{
 			shared_ptr<Chunk> chunk(file.load_chunk(pos));
-			assert(chunk != nullptr);
+			if(chunk == nullptr)
+			{
+				// the saved chunk could not be read (the error is logged), so it is made again
+				// enqueued before it is dequeued here, so that get_or_make_chunk does not load it again in between
+				gen_thread.enqueue(pos);
+				load_thread.dequeue(pos);
+				return;
+			}
 			loaded_chunks.enqueue(chunk);
-			mesh_thread.enqueue(chunk);
-		}, 2, position::hasher<chunk_in_world>),
+		}, job_scheduler, load_rank, position::hasher<chunk_in_world>, [this](const chunk_in_world& pos)
+		{
+			return job_priority(pos);
+		}),
 		mesh_thread([this](shared_ptr<Chunk>& chunk)
 		{
 			assert(chunk != nullptr);
-			chunk->update();
+			// dequeue first, so that sections marked dirty while this updates are enqueued again instead of being dropped
 			mesh_thread.dequeue(chunk);
-		}, 2)
+			chunk->update();
+			chunk->advance_stage(Chunk::stage::meshable, Chunk::stage::meshed);
+		}, job_scheduler, mesh_rank, std::hash<shared_ptr<Chunk>>(), [this](const shared_ptr<Chunk>& chunk)
+		{
+			return job_priority(chunk->get_position());
+		}),
+		light(world, job_scheduler, light_rank)
 	{
 	}
 
 	world& world;
 
-	position::unordered_map_t<chunk_in_world, shared_ptr<Chunk>> chunks;
-	mutable std::mutex chunks_mutex;
+	// read by every thread (such as meshers reading the blocks of neighbors) and written by the main thread
+	util::concurrent_map<chunk_in_world, shared_ptr<Chunk>, position::hasher_struct<chunk_in_world>> chunks;
 
 	std::unordered_set<chunk_in_world, position::hasher_struct<chunk_in_world>> chunks_to_save;
 
+	// blocks whose light or filter changed this tick, relit together by flush_light
+	std::unordered_set<block_in_world, position::hasher_struct<block_in_world>> light_dirty;
+
+	heightmap heights;
+	// the sky started or stopped reaching some blocks, so their light is found again
+	const heightmap::changed_t sky_changed = [this]
+	(
+		const heightmap::value_type x,
+		const heightmap::value_type z,
+		const heightmap::value_type y_min,
+		const heightmap::value_type y_max
+	)
+	{
+		for(heightmap::value_type y = y_min; y <= y_max; ++y)
+		{
+			light_dirty.emplace(x, y, z);
+		}
+	};
+
 	std::unordered_map<string, shared_ptr<Player>> players;
 
 	storage::world_file file;
 
+	struct job_focus_t
+	{
+		chunk_in_world center;
+		chunk_in_world::value_type range = 0;
+		shared_ptr<const graphics::frustum> frustum; // null until set_job_focus
+	};
+	job_focus_t job_focus;
+	mutable std::mutex job_focus_mutex;
+	// calls of set_job_focus since the jobs were last sorted
+	uint64_t focus_calls = 0;
+	std::optional<double> job_priority(const chunk_in_world&) const;
+	bool in_job_range(const chunk_in_world&) const;
+
+	/**
+	 * Queue meshing for a lit chunk once its face neighbours are lit, and request the neighbours that are missing
+	 */
+	void advance_pipeline(const chunk_in_world&);
+	/**
+	 * Advance the lit chunks in the job range again, since the job of a neighbour they asked for can be cancelled when it goes out of range
+	 */
+	void advance_waiting();
+	void chunk_lit(const shared_ptr<Chunk>&);
+	void flush_light();
+	void publish_light(double budget);
+	void free_light_textures();
+
+	std::vector<std::pair<uint64_t, chunk_listener_t>> chunk_listeners;
+	uint64_t max_chunk_listener_id = 0;
+	void chunk_changed(const chunk_in_world&, const shared_ptr<Chunk>&) const;
+
+	// the tick when each chunk was last in the render distance plus the margin, so that the least recently used are unloaded first
+	position::unordered_map_t<chunk_in_world, uint64_t> last_near;
+	/**
+	 * Unload the chunks out of range that were used least recently, until there are no more than the budget
+	 */
+	void unload_chunks();
+
+	void update_chunk(const shared_ptr<Chunk>&, bool thread = true);
 	void update_chunk_neighbors
 	(
-		const chunk_in_world&,
+		const Chunk&,
 		bool thread = true
 	);
-	void update_chunk_neighbors
+	void update_block_neighbors
 	(
-		const chunk_in_world&,
+		Chunk&,
 		const block_in_chunk&,
+		const block::base& old_block,
+		const block::base& block,
 		bool thread = true
 	);
 	void update_chunk_neighbor
 	(
-		const chunk_in_world&,
-		const chunk_in_world&,
+		const Chunk&,
+		const glm::ivec3& offset,
 		bool thread = true
 	);
 
@@ -110,18 +217,15 @@ struct world::impl
 
 	util::ThreadThingy<shared_ptr<Chunk>> mesh_thread;
 
-	std::queue<block_in_world> blocklight_add;
-	void add_blocklight(const block_in_world&, const graphics::color&, bool save);
-	void process_blocklight_add();
-	void sub_blocklight(const block_in_world&);
-	void update_blocklight_around(const block_in_world&);
+	light_engine light;
 };
 
 world::world
 (
 	const fs::path& file_path,
 	block::BlockRegistry& block_registry,
-	unique_ptr<mesher::Base> mesher
+	unique_ptr<mesher::Base> mesher,
+	util::job_scheduler& job_scheduler
 )
 :
 	block_registry(block_registry),
@@ -130,7 +234,8 @@ world::world
 	pImpl(std::make_unique<impl>
 	(
 		*this,
-		file_path
+		file_path,
+		job_scheduler
 	))
 {
 }
@@ -141,20 +246,7 @@ world::~world()
 	pImpl->gen_thread.stop();
 	pImpl->load_thread.stop();
 	pImpl->mesh_thread.stop();
-}
-
-static bool does_affect_light(const block::base& block)
-{
-	if(block.is_opaque())
-	{
-		return true;
-	}
-	static graphics::color max(graphics::color::max);
-	if(block.is_translucent() && block.light_filter() != max)
-	{
-		return true;
-	}
-	return false;
+	pImpl->light.stop();
 }
 
 void world::set_block
@@ -177,51 +269,30 @@ void world::set_block
 		return;
 	}
 
-	const shared_ptr<block::base> old_block = get_block(block_pos);
+	const block_in_chunk pos(block_pos);
+	const shared_ptr<block::base> old_block = chunk->get_block(pos);
 	if(old_block == block)
 	{
 		return;
 	}
 
-	const block_in_chunk pos(block_pos);
 	chunk->set_block(pos, block);
 	pImpl->chunks_to_save.emplace(chunk_pos);
 
-	const bool old_affects_light = does_affect_light(*old_block);
-	const bool affects_light = does_affect_light(*block);
-
-	const graphics::color old_light = old_block->light();
-	const graphics::color light = block->light();
-
-	// TODO: these checks might not work (a filter block could be overwritten by a different filter block)
-	if(affects_light && !old_affects_light)
+	if(old_block->is_opaque() != block->is_opaque())
 	{
-		pImpl->sub_blocklight(block_pos);
-	}
-
-	if(old_light != light)
-	{
-		if(old_light != 0)
-		{
-			pImpl->sub_blocklight(block_pos);
-		}
-		pImpl->add_blocklight(block_pos, light, false);
+		pImpl->heights.set_column(chunk_pos, chunk->get_heightmap(), pos, pImpl->sky_changed);
 	}
 
-	if(affects_light != old_affects_light)
+	if(old_block->light() != block->light()
+	|| light_engine::filter(*old_block) != light_engine::filter(*block))
 	{
-		pImpl->update_blocklight_around(block_pos);
+		pImpl->light_dirty.emplace(block_pos);
 	}
 
-	pImpl->update_chunk_neighbors(chunk_pos, pos, thread);
-	if(thread)
-	{
-		pImpl->mesh_thread.enqueue(chunk);
-	}
-	else
-	{
-		chunk->update();
-	}
+	chunk->mark_dirty(pos);
+	pImpl->update_block_neighbors(*chunk, pos, *old_block, *block, thread);
+	pImpl->update_chunk(chunk, thread);
 }
 
 const shared_ptr<block::base> world::get_block(const block_in_world& block_pos) const
@@ -252,6 +323,37 @@ shared_ptr<block::base> world::get_block(const block_in_world& block_pos)
 	return chunk->get_block(pos);
 }
 
+heightmap::value_type world::get_surface_height(const heightmap::value_type x, const heightmap::value_type z) const
+{
+	const heightmap::value_type height = pImpl->heights.get(x, z);
+	if(height != heightmap::none)
+	{
+		return height;
+	}
+	// nothing is there yet, so it is where the ground will be generated
+	return terrain_height(x, z);
+}
+
+const heightmap& world::get_heightmap() const
+{
+	return pImpl->heights;
+}
+
+graphics::color::value_type world::get_skylight(const block_in_world& block_pos) const
+{
+	// above the highest opaque block, the sky reaches without spreading
+	if(block_pos.y > pImpl->heights.get(block_pos.x, block_pos.z))
+	{
+		return graphics::color::max;
+	}
+	const shared_ptr<Chunk> chunk = get_chunk(chunk_in_world(block_pos));
+	if(chunk == nullptr)
+	{
+		return 0;
+	}
+	return chunk->get_skylight(block_in_chunk(block_pos));
+}
+
 graphics::color world::get_blocklight(const block_in_world& block_pos) const
 {
 	const chunk_in_world chunk_pos(block_pos);
@@ -270,68 +372,12 @@ void world::set_blocklight
 	bool save
 )
 {
-	const chunk_in_world chunk_pos(block_pos);
-	shared_ptr<Chunk> chunk = get_chunk(chunk_pos);
-	if(chunk == nullptr)
-	{
-		// TODO?: handle this better
-		return;
-	}
-	const block_in_chunk pos(block_pos);
-	chunk->set_blocklight(pos, color);
-
-	// update light in neighboring chunks
-	{
-		glm::tvec3<bool> xyz(false, false, false);
-		glm::tvec3<bool> zero(glm::uninitialize);
-		auto do_it = [this, &chunk_pos, &color, &pos, &zero](const glm::tvec3<bool>& xyz)
-		{
-			chunk_in_world chunk_pos_2 = chunk_pos;
-			if(xyz.x) chunk_pos_2.x += (zero.x ? -1 : 1);
-			if(xyz.y) chunk_pos_2.y += (zero.y ? -1 : 1);
-			if(xyz.z) chunk_pos_2.z += (zero.z ? -1 : 1);
-			auto chunk2 = get_chunk(chunk_pos_2);
-			if(chunk2 != nullptr)
-			{
-				glm::ivec3 pos2(glm::uninitialize);
-				pos2.x = xyz.x ? (zero.x ? CHUNK_SIZE : -1) : pos.x;
-				pos2.y = xyz.y ? (zero.y ? CHUNK_SIZE : -1) : pos.y;
-				pos2.z = xyz.z ? (zero.z ? CHUNK_SIZE : -1) : pos.z;
-				chunk2->set_texbuflight(pos2, color);
-			}
-		};
-		for(uint_fast8_t i = 0; i < 3; ++i)
-		{
-			if(pos[i] == 0 || pos[i] == CHUNK_SIZE - 1)
-			{
-				xyz[i] = true;
-				zero[i] = (pos[i] == 0);
-			}
-		}
-		for(uint_fast8_t i = 0; i < 3; ++i)
-		{
-			const uint_fast8_t j = (i + 1) % 3;
-			if(xyz[i])
-			{
-				glm::tvec3<bool> xyz2(false, false, false);
-				xyz2[i] = true;
-				do_it(xyz2);
-				if(xyz[j])
-				{
-					xyz2[j] = true;
-					do_it(xyz2);
-				}
-			}
-		}
-		if(xyz.x && xyz.y && xyz.z)
-		{
-			do_it({true, true, true});
-		}
-	}
-
+	// keep the order of changes to the same blocks
+	pImpl->flush_light();
+	pImpl->light.set_light(block_pos, color);
 	if(save)
 	{
-		pImpl->chunks_to_save.emplace(chunk_pos);
+		pImpl->chunks_to_save.emplace(chunk_in_world(block_pos));
 	}
 }
 
@@ -351,276 +397,372 @@ void world::update_blocklight
 	const bool save
 )
 {
-	pImpl->sub_blocklight(block_pos);
-	pImpl->add_blocklight(block_pos, color, save);
+	// keep the order of changes to the same blocks
+	pImpl->flush_light();
+	pImpl->light.update_block(block_pos, color);
+	if(save)
+	{
+		pImpl->chunks_to_save.emplace(chunk_in_world(block_pos));
+	}
 }
 
-void world::impl::add_blocklight
-(
-	const block_in_world& block_pos,
-	const graphics::color& color,
-	const bool save
-)
+void world::set_chunk(const chunk_in_world& chunk_pos, shared_ptr<Chunk> chunk)
 {
-	world.set_blocklight(block_pos, color, save);
-	if(color == 0)
+	const shared_ptr<Chunk> prev_chunk = get_chunk(chunk_pos);
+	if(prev_chunk == chunk)
 	{
 		return;
 	}
+	if(prev_chunk != nullptr)
+	{
+		prev_chunk->clear_neighbors();
+		// the last reference to it can be dropped on a job thread, which can not free its graphics
+		prev_chunk->free_graphics();
+	}
+	if(chunk == nullptr)
+	{
+		pImpl->chunks.erase(chunk_pos);
+		pImpl->last_near.erase(chunk_pos);
+		link_neighbors(chunk_pos, nullptr);
+		if(prev_chunk != nullptr)
+		{
+			pImpl->heights.remove_chunk(chunk_pos, pImpl->sky_changed);
+			pImpl->chunk_changed(chunk_pos, nullptr);
+		}
+		return;
+	}
+
+	pImpl->chunks.set(chunk_pos, chunk);
+	pImpl->chunk_changed(chunk_pos, chunk);
+	pImpl->last_near.insert_or_assign(chunk_pos, ticks);
+	// before the light job, which goes between chunks by these links
+	link_neighbors(chunk_pos, chunk);
+
+	// the heights are set first, since the light job uses them to find where the sky reaches
+	pImpl->heights.set_chunk(chunk_pos, chunk->get_heightmap(), pImpl->sky_changed);
 
-	// see https://www.seedofandromeda.com/blogs/29-fast-flood-fill-lighting-in-a-blocky-voxel-game-pt-1
-	blocklight_add.emplace(block_pos);
-	process_blocklight_add();
+	// the chunk is lit by a job, then chunk_lit moves it along the pipeline
+	pImpl->light.add_chunk(chunk);
+
+	if(prev_chunk != nullptr)
+	{
+		// the neighbours were meshed with the blocks of the replaced chunk
+		pImpl->update_chunk_neighbors(*chunk);
+	}
 }
 
-void world::impl::process_blocklight_add()
+void world::link_neighbors(const chunk_in_world& chunk_pos, const shared_ptr<Chunk>& chunk)
 {
-	while(!blocklight_add.empty())
+	glm::ivec3 d;
+	for(d.x = -1; d.x <= 1; ++d.x)
+	for(d.y = -1; d.y <= 1; ++d.y)
+	for(d.z = -1; d.z <= 1; ++d.z)
 	{
-		const block_in_world pos = blocklight_add.front();
-		blocklight_add.pop();
-		const graphics::color color = world.get_blocklight(pos) - 1;
-		if(color == 0)
+		if(d == glm::ivec3(0))
 		{
 			continue;
 		}
-
-		auto fill =
-		[
-			this,
-			&pos
-		]
-		(
-			const int8_t x,
-			const int8_t y,
-			const int8_t z,
-			graphics::color color
-		)
+		const shared_ptr<Chunk> neighbor = get_chunk(chunk_pos + chunk_in_world(d.x, d.y, d.z));
+		if(neighbor != nullptr)
 		{
-			const block_in_world pos2{pos.x + x, pos.y + y, pos.z + z};
-			const shared_ptr<Chunk> chunk = this->world.get_chunk(chunk_in_world(pos2)); // this-> to work around MSVC lambda scope bug
-			if(chunk == nullptr)
-			{
-				return;
-			}
-			const block_in_chunk pos2b(pos2);
-			const shared_ptr<block::base> block = chunk->get_block(pos2b);
-			if(block->is_opaque())
-			{
-				return;
-			}
-			if(block->is_translucent())
-			{
-				const graphics::color f = block->light_filter();
-				color.r = std::min(color.r, f.r);
-				color.g = std::min(color.g, f.g);
-				color.b = std::min(color.b, f.b);
-			}
-			graphics::color color2 = chunk->get_blocklight(pos2b);
-			bool set = false;
-			if(color2.r < color.r) { color2.r = color.r; set = true; }
-			if(color2.g < color.g) { color2.g = color.g; set = true; }
-			if(color2.b < color.b) { color2.b = color.b; set = true; }
-			if(set)
-			{
-				this->world.set_blocklight(pos2, color2, false); // this-> to work around MSVC lambda scope bug
-				blocklight_add.emplace(pos2);
-			}
-		};
-
-		fill( 0,  0, -1, color);
-		fill( 0,  0, +1, color);
-		fill( 0, -1,  0, color);
-		fill( 0, +1,  0, color);
-		fill(-1,  0,  0, color);
-		fill(+1,  0,  0, color);
+			neighbor->set_neighbor(-d, chunk);
+		}
+		if(chunk != nullptr)
+		{
+			chunk->set_neighbor(d, neighbor);
+		}
 	}
 }
 
-void world::impl::sub_blocklight(const block_in_world& block_pos)
+void world::unload_chunk(const chunk_in_world& chunk_pos)
 {
-	const graphics::color color = world.get_blocklight(block_pos);
-	if(color == 0)
+	const shared_ptr<Chunk> chunk = pImpl->chunks.erase(chunk_pos);
+	if(chunk == nullptr)
 	{
 		return;
 	}
-	world.set_blocklight(block_pos, {0, 0, 0}, false);
-
-	std::queue<std::tuple<block_in_world, graphics::color>> q;
-	q.emplace(block_pos, color);
-	while(!q.empty())
-	{
-		const block_in_world pos = std::get<0>(q.front());
-		const graphics::color color = std::get<1>(q.front());
-		q.pop();
-
-		auto fill =
-		[
-			this,
-			&q,
-			&pos
-		]
-		(
-			const graphics::color& color,
-			const int8_t x,
-			const int8_t y,
-			const int8_t z
-		)
+	pImpl->chunk_changed(chunk_pos, nullptr);
+	pImpl->last_near.erase(chunk_pos);
+	if(pImpl->chunks_to_save.erase(chunk_pos) != 0)
+	{
+		pImpl->file.save_chunk(*chunk);
+	}
+	chunk->clear_neighbors();
+	link_neighbors(chunk_pos, nullptr);
+	// the chunk is still there when it is not loaded, so its heights keep stopping the sky
+	pImpl->heights.unload_chunk(chunk_pos);
+	chunk->free_graphics();
+}
+
+void world::impl::unload_chunks()
+{
+	chunk_in_world center;
+	chunk_in_world::value_type range;
+	{
+		std::lock_guard<std::mutex> g(job_focus_mutex);
+		if(job_focus.frustum == nullptr)
 		{
-			const block_in_world pos2{pos.x + x, pos.y + y, pos.z + z};
-			graphics::color color2 = this->world.get_blocklight(pos2); // this-> to work around MSVC lambda scope bug
-			graphics::color color_set = color2;
-			graphics::color color_put(0, 0, 0);
+			// nothing was drawn yet
+			return;
+		}
+		center = job_focus.center;
+		range = job_focus.range + static_cast<chunk_in_world::value_type>(settings::get<int64_t>("unload_margin"));
+	}
 
-			bool set = false;
-			for(uint_fast8_t i = 0; i < 3; ++i)
-			{
-				if(color2[i] != 0 && color2[i] < color[i])
-				{
-					color_set[i] = 0;
-					color_put[i] = color2[i];
-					set = true;
-				}
-				else if(color2[i] >= color[i])
-				{
-					blocklight_add.emplace(pos2);
-				}
-			}
-			if(set)
-			{
-				this->world.set_blocklight(pos2, color_set, false); // this-> to work around MSVC lambda scope bug
-				q.emplace(pos2, color_put);
-			}
-		};
+	// (tick when it was last in range, position) of the chunks that are out of range
+	std::vector<std::pair<uint64_t, chunk_in_world>> far;
+	chunks.for_each([this, &center, range, &far](const chunk_in_world& chunk_pos, const shared_ptr<Chunk>&)
+	{
+		const chunk_in_world d = chunk_pos - center;
+		if(std::max({std::abs(d.x), std::abs(d.y), std::abs(d.z)}) <= range)
+		{
+			last_near.insert_or_assign(chunk_pos, world.ticks);
+		}
+		else
+		{
+			far.emplace_back(last_near[chunk_pos], chunk_pos);
+		}
+	});
 
-		fill(color,  0,  0, -1);
-		fill(color,  0,  0, +1);
-		fill(color,  0, -1,  0);
-		fill(color,  0, +1,  0);
-		fill(color, -1,  0,  0);
-		fill(color, +1,  0,  0);
+	const std::size_t budget = static_cast<std::size_t>(std::max<int64_t>(settings::get<int64_t>("chunk_budget"), 0));
+	const std::size_t count = chunks.size();
+	if(count <= budget || far.empty())
+	{
+		return;
 	}
-}
 
-void world::impl::update_blocklight_around(const block_in_world& block_pos)
-{
-	#define a(x_, y_, z_) blocklight_add.emplace(block_pos.x + x_, block_pos.y + y_, block_pos.z + z_)
-	a( 0,  0, -1);
-	a( 0,  0, +1);
-	a( 0, -1,  0);
-	a( 0, +1,  0);
-	a(-1,  0,  0);
-	a(+1,  0,  0);
-	#undef a
-	process_blocklight_add();
+	// light is saved with the chunks, and a light job can change the chunks around the ones it changes
+	// so chunks are only unloaded between jobs, and the next sweep tries again if one is being done
+	flush_light();
+	if(!light.idle())
+	{
+		return;
+	}
+	// the light of finished jobs is put in the chunks first, so that it is saved with them
+	publish_light(std::numeric_limits<double>::infinity());
+
+	// the least recently used first
+	const std::size_t unload_count = std::min(count - budget, far.size());
+	std::partial_sort(far.begin(), far.begin() + static_cast<std::ptrdiff_t>(unload_count), far.end(), [](const auto& a, const auto& b)
+	{
+		return a.first < b.first;
+	});
+	for(std::size_t i = 0; i < unload_count; ++i)
+	{
+		world.unload_chunk(far[i].second);
+	}
 }
 
-void world::set_chunk(const chunk_in_world& chunk_pos, shared_ptr<Chunk> chunk)
+void world::impl::chunk_lit(const shared_ptr<Chunk>& chunk)
 {
-	const shared_ptr<Chunk> prev_chunk = get_chunk(chunk_pos);
-	if(prev_chunk == chunk)
+	if(!chunk->advance_stage(Chunk::stage::made, Chunk::stage::lit))
 	{
 		return;
 	}
+
+	const chunk_in_world chunk_pos = chunk->get_position();
+	advance_pipeline(chunk_pos);
+	for(uint8_t face_i = 0; face_i < 6; ++face_i)
 	{
-		std::lock_guard<std::mutex> g(pImpl->chunks_mutex);
-		pImpl->chunks.insert_or_assign(chunk_pos, chunk);
+		const glm::ivec3 vec = block::enums::face_to_vec(static_cast<block::enums::Face>(face_i));
+		advance_pipeline(chunk_pos + chunk_in_world(vec.x, vec.y, vec.z));
 	}
-	if(chunk == nullptr)
+}
+
+void world::impl::flush_light()
+{
+	if(light_dirty.empty())
 	{
 		return;
 	}
+	light.update_blocks(std::vector<block_in_world>(light_dirty.cbegin(), light_dirty.cend()));
+	light_dirty.clear();
+}
 
-	// update light at chunk sides to make it flow into the new chunk
+void world::impl::publish_light(const double budget)
+{
+	light.publish([this](const shared_ptr<Chunk>& chunk)
 	{
-		block_in_world pos1(chunk_pos, {0, 0, 0});
-		block_in_world pos;
-		for(uint_fast8_t i1 = 0; i1 < 3; ++i1)
-		{
-			uint_fast8_t i2 = (i1 + 1) % 3;
-			uint_fast8_t i3 = (i1 + 2) % 3;
-			for(pos[i1] = pos1[i1]; pos[i1] < pos1[i1] + CHUNK_SIZE; ++pos[i1])
-			for(pos[i2] = pos1[i2]; pos[i2] < pos1[i2] + CHUNK_SIZE; ++pos[i2])
-			{
-				block_in_world pos2(pos);
-
-				pos2[i3] = pos1[i3] - 1;
-				pImpl->blocklight_add.emplace(pos2);
+		// light is saved with the chunk
+		chunks_to_save.emplace(chunk->get_position());
+	},
+	[this](const shared_ptr<Chunk>& chunk)
+	{
+		chunk_lit(chunk);
+	}, budget);
+}
 
-				pos2[i3] = pos1[i3] + CHUNK_SIZE;
-				pImpl->blocklight_add.emplace(pos2);
-			}
-		}
-		pImpl->process_blocklight_add();
+void world::impl::free_light_textures()
+{
+	if(world.ticks < light_tex_keep_ticks)
+	{
+		return;
 	}
+	const uint64_t tick = world.ticks - light_tex_keep_ticks;
+	chunks.for_each([tick](const chunk_in_world&, const shared_ptr<Chunk>& chunk)
+	{
+		chunk->free_light_tex(tick);
+	});
+}
 
-	// update light in chunk
+void world::impl::advance_waiting()
+{
+	std::vector<chunk_in_world> waiting;
+	chunks.for_each([this, &waiting](const chunk_in_world& chunk_pos, const shared_ptr<Chunk>& chunk)
 	{
-		block_in_chunk pos;
-		for(pos.x = 0; pos.x < CHUNK_SIZE; ++pos.x)
-		for(pos.y = 0; pos.y < CHUNK_SIZE; ++pos.y)
-		for(pos.z = 0; pos.z < CHUNK_SIZE; ++pos.z)
+		if(chunk->get_stage() == Chunk::stage::lit && in_job_range(chunk_pos))
 		{
-			shared_ptr<block::base> block = chunk->get_block(pos);
-			assert(block != nullptr);
-			const graphics::color light = block->light();
-			if(light != 0)
-			{
-				pImpl->add_blocklight({chunk_pos, pos}, light, false);
-			}
+			waiting.emplace_back(chunk_pos);
 		}
+	});
+	for(const chunk_in_world& chunk_pos : waiting)
+	{
+		advance_pipeline(chunk_pos);
+	}
+}
+
+void world::impl::advance_pipeline(const chunk_in_world& chunk_pos)
+{
+	const shared_ptr<Chunk> chunk = world.get_chunk(chunk_pos);
+	if(chunk == nullptr || chunk->get_stage() != Chunk::stage::lit)
+	{
+		return;
 	}
 
+	bool has_neighbors = true;
+	for(uint8_t face_i = 0; face_i < 6; ++face_i)
 	{
-		glm::ivec3 pos2;
-		for(pos2.x = -1; pos2.x < CHUNK_SIZE + 1; ++pos2.x)
-		for(pos2.y = -1; pos2.y < CHUNK_SIZE + 1; ++pos2.y)
-		for(pos2.z = -1; pos2.z < CHUNK_SIZE + 1; ++pos2.z)
+		const glm::ivec3 vec = block::enums::face_to_vec(static_cast<block::enums::Face>(face_i));
+		const shared_ptr<Chunk> neighbor = chunk->get_neighbor(vec);
+		if(neighbor == nullptr || neighbor->get_stage() < Chunk::stage::lit)
 		{
-			chunk_in_world chunk_pos_2 = chunk_pos;
-			block_in_chunk pos;
-			for(uint_fast8_t i = 0; i < 3; ++i)
+			has_neighbors = false;
+			// chunks past the job range only wait, so that requesting neighbours does not spread forever
+			if(neighbor == nullptr && in_job_range(chunk_pos))
 			{
-				if(pos2[i] == -1)
-				{
-					chunk_pos_2[i] -= 1;
-					pos[i] = CHUNK_SIZE - 1;
-				}
-				else if(pos2[i] == CHUNK_SIZE)
-				{
-					chunk_pos_2[i] += 1;
-					pos[i] = 0;
-				}
-				else
-				{
-					pos[i] = static_cast<block_in_chunk::value_type>(pos2[i]);
-				}
-			}
-			if(chunk_pos_2 == chunk_pos)
-			{
-				continue;
-			}
-			const auto chunk2 = get_chunk(chunk_pos_2);
-			if(chunk2 != nullptr)
-			{
-				chunk->set_texbuflight(pos2, chunk2->get_blocklight(pos));
+				world.get_or_make_chunk(chunk_pos + chunk_in_world(vec.x, vec.y, vec.z));
 			}
 		}
 	}
+	if(!has_neighbors)
+	{
+		return;
+	}
 
-	pImpl->mesh_thread.enqueue(chunk);
-	pImpl->update_chunk_neighbors(chunk_pos);
+	chunk->advance_stage(Chunk::stage::lit, Chunk::stage::meshable);
+	// chunks with only invisible blocks (such as air) have nothing to mesh
+	if(chunk->is_invisible())
+	{
+		chunk->advance_stage(Chunk::stage::meshable, Chunk::stage::meshed);
+	}
+	else
+	{
+		mesh_thread.enqueue(chunk);
+	}
+}
+
+void world::set_job_focus
+(
+	const chunk_in_world& center,
+	const uint64_t range,
+	shared_ptr<const graphics::frustum> frustum
+)
+{
+	bool moved;
+	{
+		std::lock_guard<std::mutex> g(pImpl->job_focus_mutex);
+		moved = center != pImpl->job_focus.center
+			|| static_cast<chunk_in_world::value_type>(range) != pImpl->job_focus.range
+			|| pImpl->job_focus.frustum == nullptr;
+		pImpl->job_focus.center = center;
+		pImpl->job_focus.range = static_cast<chunk_in_world::value_type>(range);
+		pImpl->job_focus.frustum = std::move(frustum);
+	}
+
+	// sorting every queue is too slow to do every frame
+	pImpl->focus_calls += 1;
+	if(!moved && pImpl->focus_calls < reprioritize_calls)
+	{
+		return;
+	}
+	pImpl->focus_calls = 0;
+	pImpl->gen_thread.reprioritize();
+	pImpl->load_thread.reprioritize();
+	pImpl->mesh_thread.reprioritize();
+}
+
+void world::update_chunk_if_dirty(const shared_ptr<Chunk>& chunk)
+{
+	if(chunk->get_stage() >= Chunk::stage::meshable && chunk->has_dirty_sections() && !chunk->is_invisible())
+	{
+		pImpl->mesh_thread.enqueue(chunk);
+	}
+}
+
+bool world::impl::in_job_range(const chunk_in_world& chunk_pos) const
+{
+	std::lock_guard<std::mutex> g(job_focus_mutex);
+	if(job_focus.frustum == nullptr)
+	{
+		return false;
+	}
+	const chunk_in_world d = chunk_pos - job_focus.center;
+	return std::max({std::abs(d.x), std::abs(d.y), std::abs(d.z)}) <= job_focus.range;
+}
+
+std::optional<double> world::impl::job_priority(const chunk_in_world& chunk_pos) const
+{
+	std::lock_guard<std::mutex> g(job_focus_mutex);
+	if(job_focus.frustum == nullptr)
+	{
+		return 0.0;
+	}
+
+	const chunk_in_world d = chunk_pos - job_focus.center;
+	const auto distance = std::max({std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+	// a chunk just outside of the range is kept, so that going back and forth over the edge does not redo its jobs
+	if(distance > job_focus.range + 1)
+	{
+		return std::nullopt;
+	}
+
+	double priority = static_cast<double>(d.x * d.x + d.y * d.y + d.z * d.z);
+	if(!job_focus.frustum->inside(physics::AABB(d)))
+	{
+		// after every chunk in view
+		const auto r = static_cast<double>(job_focus.range + 1);
+		priority += 3 * r * r;
+	}
+	return priority;
 }
 
 shared_ptr<Chunk> world::get_chunk(const chunk_in_world& chunk_pos) const
 {
-	std::lock_guard<std::mutex> g(pImpl->chunks_mutex);
-	const auto i = pImpl->chunks.find(chunk_pos);
-	if(i == pImpl->chunks.cend())
+	return pImpl->chunks.get(chunk_pos);
+}
+
+uint64_t world::add_chunk_listener(chunk_listener_t listener)
+{
+	const uint64_t id = pImpl->max_chunk_listener_id++;
+	pImpl->chunk_listeners.emplace_back(id, std::move(listener));
+	return id;
+}
+
+void world::remove_chunk_listener(const uint64_t id)
+{
+	auto& listeners = pImpl->chunk_listeners;
+	listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [id](const auto& p)
 	{
-		return nullptr;
+		return p.first == id;
+	}), listeners.end());
+}
+
+void world::impl::chunk_changed(const chunk_in_world& chunk_pos, const shared_ptr<Chunk>& chunk) const
+{
+	for(const auto& p : chunk_listeners)
+	{
+		p.second(chunk_pos, chunk);
 	}
-	return i->second;
 }
 
 shared_ptr<Chunk> world::get_or_make_chunk(const chunk_in_world& chunk_pos)
@@ -662,6 +804,15 @@ void world::step(double delta_time)
 		pImpl->chunks_to_save.emplace(pos);
 	}
 
+	pImpl->flush_light();
+	pImpl->publish_light(settings::get<double>("light_budget"));
+	if(ticks % sweep_ticks == 0)
+	{
+		pImpl->free_light_textures();
+		pImpl->unload_chunks();
+		pImpl->advance_waiting();
+	}
+
 	for(auto& p : pImpl->players)
 	{
 		p.second->step(delta_time);
@@ -699,6 +850,11 @@ void world::save()
 	pImpl->file.save_world();
 	pImpl->file.save_players();
 
+	// light is saved with the chunks, so finish spreading it first
+	pImpl->flush_light();
+	pImpl->light.wait();
+	pImpl->publish_light(std::numeric_limits<double>::infinity());
+
 	while(!pImpl->chunks_to_save.empty())
 	{
 		const auto i = pImpl->chunks_to_save.cbegin();
@@ -726,10 +882,14 @@ void world::set_mesher(unique_ptr<mesher::Base> mesher)
 {
 	assert(mesher != nullptr);
 	this->mesher = std::move(mesher);
-	for(auto& p : pImpl->chunks)
+	pImpl->chunks.for_each([](const chunk_in_world&, const shared_ptr<Chunk>& chunk)
 	{
-		p.second->update();
-	}
+		chunk->mark_all_dirty();
+		if(chunk->get_stage() >= Chunk::stage::meshable)
+		{
+			chunk->update();
+		}
+	});
 }
 
 bool world::is_meshing_queued(const shared_ptr<Chunk>& chunk) const
@@ -746,79 +906,124 @@ bool world::is_meshing_queued(const chunk_in_world& chunk_pos) const
 	return is_meshing_queued(get_chunk(chunk_pos));
 }
 
+void world::impl::update_chunk(const shared_ptr<Chunk>& chunk, const bool thread)
+{
+	// a chunk is meshed for the first time by the pipeline, when it has its neighbours
+	if(chunk->get_stage() < Chunk::stage::meshable)
+	{
+		return;
+	}
+	if(thread)
+	{
+		mesh_thread.enqueue(chunk);
+	}
+	else
+	{
+		chunk->update();
+	}
+}
+
 void world::impl::update_chunk_neighbors
 (
-	const chunk_in_world& chunk_pos,
+	const Chunk& chunk,
 	const bool thread
 )
 {
-	update_chunk_neighbor(chunk_pos, {-1,  0,  0}, thread);
-	update_chunk_neighbor(chunk_pos, {+1,  0,  0}, thread);
-	update_chunk_neighbor(chunk_pos, { 0, -1,  0}, thread);
-	update_chunk_neighbor(chunk_pos, { 0, +1,  0}, thread);
-	update_chunk_neighbor(chunk_pos, { 0,  0, -1}, thread);
-	update_chunk_neighbor(chunk_pos, { 0,  0, +1}, thread);
+	update_chunk_neighbor(chunk, {-1,  0,  0}, thread);
+	update_chunk_neighbor(chunk, {+1,  0,  0}, thread);
+	update_chunk_neighbor(chunk, { 0, -1,  0}, thread);
+	update_chunk_neighbor(chunk, { 0, +1,  0}, thread);
+	update_chunk_neighbor(chunk, { 0,  0, -1}, thread);
+	update_chunk_neighbor(chunk, { 0,  0, +1}, thread);
 }
 
-void world::impl::update_chunk_neighbors
+void world::impl::update_block_neighbors
 (
-	const chunk_in_world& chunk_pos,
+	Chunk& chunk,
 	const block_in_chunk& pos,
+	const block::base& old_block,
+	const block::base& block,
 	const bool thread
 )
 {
-	const auto x = pos.x;
-	const auto y = pos.y;
-	const auto z = pos.z;
-
-	// TODO: check if the neighbor chunk has a block beside this one (to avoid updating when the appearance won't change)
-	if(x == 0)
-	{
-		update_chunk_neighbor(chunk_pos, {-1, 0, 0}, thread);
-	}
-	else if(x == CHUNK_SIZE - 1)
+	// the section of the block itself is already dirty
+	// a neighbor in another section only changes if its face that touches the block is shown or hidden
+	for(uint8_t face_i = 0; face_i < 6; ++face_i)
 	{
-		update_chunk_neighbor(chunk_pos, {+1, 0, 0}, thread);
-	}
+		const glm::ivec3 vec = block::enums::face_to_vec(static_cast<block::enums::Face>(face_i));
+		const Chunk::near_position near = Chunk::resolve_near(glm::ivec3(pos.x + vec.x, pos.y + vec.y, pos.z + vec.z));
+		const block_in_chunk& pos2b = near.pos;
 
-	if(y == 0)
-	{
-		update_chunk_neighbor(chunk_pos, {0, -1, 0}, thread);
-	}
-	else if(y == CHUNK_SIZE - 1)
-	{
-		update_chunk_neighbor(chunk_pos, {0, +1, 0}, thread);
-	}
+		shared_ptr<Chunk> chunk2;
+		if(near.offset == glm::ivec3(0))
+		{
+			if(pos.x / CHUNK_SECTION_SIZE == pos2b.x / CHUNK_SECTION_SIZE
+			&& pos.y / CHUNK_SECTION_SIZE == pos2b.y / CHUNK_SECTION_SIZE
+			&& pos.z / CHUNK_SECTION_SIZE == pos2b.z / CHUNK_SECTION_SIZE)
+			{
+				continue;
+			}
+		}
+		else
+		{
+			chunk2 = chunk.get_neighbor(near.offset);
+			if(chunk2 == nullptr)
+			{
+				continue;
+			}
+		}
+		Chunk& c2 = (chunk2 != nullptr) ? *chunk2 : chunk;
 
-	if(z == 0)
-	{
-		update_chunk_neighbor(chunk_pos, {0, 0, -1}, thread);
-	}
-	else if(z == CHUNK_SIZE - 1)
-	{
-		update_chunk_neighbor(chunk_pos, {0, 0, +1}, thread);
+		// an invisible chunk has no faces, so its neighbors do not affect it
+		if(c2.is_invisible())
+		{
+			continue;
+		}
+		const shared_ptr<block::base> neighbor = c2.get_block(pos2b);
+		if(mesher::Base::face_visible(*neighbor, old_block) == mesher::Base::face_visible(*neighbor, block))
+		{
+			continue;
+		}
+		c2.mark_dirty(pos2b);
+		if(chunk2 != nullptr)
+		{
+			update_chunk(chunk2, thread);
+		}
 	}
 }
 
 void world::impl::update_chunk_neighbor
 (
-	const chunk_in_world& chunk_pos,
-	const chunk_in_world& offset,
+	const Chunk& chunk_from,
+	const glm::ivec3& offset,
 	const bool thread
 )
 {
-	shared_ptr<Chunk> chunk = world.get_chunk(chunk_pos + offset);
-	if(chunk != nullptr)
+	shared_ptr<Chunk> chunk = chunk_from.get_neighbor(offset);
+	// an invisible chunk has no faces, so its neighbors do not affect it
+	if(chunk == nullptr || chunk->is_invisible())
 	{
-		if(thread)
-		{
-			mesh_thread.enqueue(chunk);
-		}
-		else
-		{
-			chunk->update();
-		}
+		return;
 	}
+
+	// only the sections on the side that touches chunk_from can change
+	int axis = 0;
+	while(offset[axis] == 0)
+	{
+		++axis;
+	}
+	const auto side = static_cast<block_in_chunk::value_type>(offset[axis] > 0 ? 0 : CHUNK_SIZE - 1);
+	constexpr auto last = static_cast<block_in_chunk::value_type>(CHUNK_SIZE - 1);
+	for(const auto a : {block_in_chunk::value_type(0), last})
+	for(const auto b : {block_in_chunk::value_type(0), last})
+	{
+		block_in_chunk pos;
+		pos[axis] = side;
+		pos[(axis + 1) % 3] = a;
+		pos[(axis + 2) % 3] = b;
+		chunk->mark_dirty(pos);
+	}
+	update_chunk(chunk, thread);
 }
 
 static double sum_noise
@@ -839,6 +1044,23 @@ static double sum_noise
 	return val;
 }
 
+// the ground is from -terrain_depth to 0
+constexpr double terrain_depth = 20;
+
+// the y of the top block that gen_chunk puts at (x, z)
+// https://www.shadertoy.com/view/Xl3GWS
+static block_in_world::value_type terrain_height(const block_in_world::value_type x, const block_in_world::value_type z)
+{
+	// coords must not be (0, 0) (it makes this function always return 0)
+	const glm::dvec2 coords = (x == 0 && z == 0) ? glm::dvec2(0.0001) : glm::dvec2(x, z) / 1024.0;
+	const glm::dvec2 n(-sum_noise(coords, 1, 2.07, 8));
+
+	const double a = n.x * n.y;
+	const double b = glm::mod(a, 1.0);
+	const auto d = static_cast<uint_fast8_t>(glm::mod(ceil(a), 2.0));
+	return static_cast<block_in_world::value_type>(std::round(((d == 0 ? b : 1 - b) - 1) * terrain_depth));
+}
+
 void world::impl::gen_chunk(shared_ptr<Chunk> chunk) const
 {
 	assert(chunk != nullptr);
@@ -846,32 +1068,18 @@ void world::impl::gen_chunk(shared_ptr<Chunk> chunk) const
 	const chunk_in_world chunk_pos = chunk->get_position();
 	const block_in_world min(chunk_pos, {0, 0, 0});
 	const block_in_world max(chunk_pos, {CHUNK_SIZE - 1, CHUNK_SIZE - 1, CHUNK_SIZE - 1});
+	if(min.y > 0)
+	{
+		// the sky
+		return;
+	}
 
+	// Chunk::set_block keeps the chunk's heightmap, so the heights do not have to be found from the blocks after this
 	block_in_world block_pos(0, 0, 0);
 	for(auto x = min.x; x <= max.x; ++x)
 	for(auto z = min.z; z <= max.z; ++z)
 	{
-		const double m = 20;
-		if(min.y > 0)
-		{
-			continue;
-		}
-
-		// https://www.shadertoy.com/view/Xl3GWS
-		auto get_max_y = [](const block_in_world::value_type x, const block_in_world::value_type z) -> double
-		{
-			// coords must not be (0, 0) (it makes this function always return 0)
-			const glm::dvec2 coords = (x == 0 && z == 0) ? glm::dvec2(0.0001) : glm::dvec2(x, z) / 1024.0;
-			const glm::dvec2 n(-sum_noise(coords, 1, 2.07, 8));
-
-			const double a = n.x * n.y;
-			const double b = glm::mod(a, 1.0);
-			const auto d = static_cast<uint_fast8_t>(glm::mod(ceil(a), 2.0));
-			return (d == 0 ? b : 1 - b) - 1;
-		};
-
-		const auto real_max_y = static_cast<block_in_world::value_type>(std::round(get_max_y(x, z) * m));
-		const auto max_y = max.y <= -m ? max.y : std::min(max.y, real_max_y);
+		const auto max_y = max.y <= -terrain_depth ? max.y : std::min(max.y, terrain_height(x, z));
 
 		block_pos.x = x;
 		block_pos.z = z;
@@ -880,7 +1088,7 @@ void world::impl::gen_chunk(shared_ptr<Chunk> chunk) const
 			block_pos.y = y;
 
 			// TODO: investigate performance of using strings here vs caching the IDs
-			const string t = y > -m / 2 ? "test_white" : "test_black";
+			const string t = y > -terrain_depth / 2 ? "test_white" : "test_black";
 			chunk->set_block(block_in_chunk(block_pos), world.block_registry.get_default(t));
 		}
 	}
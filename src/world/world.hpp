@@ -13,11 +13,14 @@
 #include "fwd/block/BlockRegistry.hpp"
 #include "fwd/chunk/Chunk.hpp"
 #include "fwd/chunk/Mesher/Base.hpp"
-#include "fwd/graphics/color.hpp"
-#include "fwd/position/block_in_world.hpp"
+#include "fwd/graphics/frustum.hpp"
+#include "graphics/color.hpp"
 #include "fwd/position/chunk_in_world.hpp"
+#include "position/block_in_world.hpp"
 #include "shim/propagate_const.hpp"
 #include "util/filesystem.hpp"
+#include "fwd/util/job_scheduler.hpp"
+#include "fwd/world/heightmap.hpp"
 
 namespace block_thingy::world {
 
@@ -28,7 +31,8 @@ public:
 	(
 		const fs::path& file_path,
 		block::BlockRegistry&,
-		std::unique_ptr<mesher::Base>
+		std::unique_ptr<mesher::Base>,
+		util::job_scheduler&
 	);
 	~world();
 
@@ -37,6 +41,10 @@ public:
 	world& operator=(world&&) = delete;
 	world& operator=(const world&) = delete;
 
+	/**
+	 * Each call synchronizes with writers of the chunk map and the chunk (a util::epoch::guard).
+	 * A loop that gets many blocks can hold one guard around itself, so that the calls inside it do not.
+	 */
 	const std::shared_ptr<block::base> get_block(const position::block_in_world&) const;
 	std::shared_ptr<block::base> get_block(const position::block_in_world&);
 
@@ -47,6 +55,17 @@ public:
 		bool thread = true
 	);
 
+	/**
+	 * The highest opaque block of each column, from the chunks in the world
+	 */
+	const heightmap& get_heightmap() const;
+
+	/**
+	 * @return The y of the highest opaque block at (x, z), or where the ground will be generated if there is none yet
+	 */
+	position::block_in_world::value_type get_surface_height(position::block_in_world::value_type x, position::block_in_world::value_type z) const;
+
+	graphics::color::value_type get_skylight(const position::block_in_world&) const;
 	graphics::color get_blocklight(const position::block_in_world&) const;
 	void set_blocklight(const position::block_in_world&, const graphics::color&, bool save);
 	void update_blocklight(const position::block_in_world&, bool save);
@@ -56,6 +75,31 @@ public:
 	std::shared_ptr<Chunk> get_or_make_chunk(const position::chunk_in_world&);
 	void set_chunk(const position::chunk_in_world&, std::shared_ptr<Chunk> chunk);
 
+	/**
+	 * Called with the position and the new chunk when a chunk is put in the world or replaced, and with nullptr when one is taken out,
+	 * so that something that keeps chunks between frames does not have to look them up again
+	 */
+	using chunk_listener_t = std::function<void(const position::chunk_in_world&, const std::shared_ptr<Chunk>&)>;
+	uint64_t add_chunk_listener(chunk_listener_t);
+	void remove_chunk_listener(uint64_t id);
+
+	/**
+	 * Generating, loading, and meshing are done for the chunks nearest to `center` first, and for the chunks in the frustum before others.
+	 * Jobs for chunks more than `range` chunks away are cancelled.
+	 * The queued jobs are sorted again when `center` or `range` changes, and otherwise only every few calls.
+	 */
+	void set_job_focus
+	(
+		const position::chunk_in_world& center,
+		uint64_t range,
+		std::shared_ptr<const graphics::frustum>
+	);
+
+	/**
+	 * Queue meshing for a chunk with dirty sections, such as one whose meshing was cancelled when it left the job range
+	 */
+	void update_chunk_if_dirty(const std::shared_ptr<Chunk>&);
+
 	void step(double delta_time);
 
 	std::shared_ptr<Player> add_player(const std::string& name);
@@ -81,6 +125,17 @@ public:
 private:
 	uint64_t ticks;
 
+	/**
+	 * Link a chunk and its 26 neighbours to each other, or unlink the neighbours if it is `nullptr`
+	 */
+	void link_neighbors(const position::chunk_in_world&, const std::shared_ptr<Chunk>&);
+
+	/**
+	 * Take a chunk out of the world to free its memory, after saving it if it changed.
+	 * Unlike removing it with `set_chunk`, this does not change anything around it (the heightmap, light, and meshes of its neighbours), since it is still there on disk.
+	 */
+	void unload_chunk(const position::chunk_in_world&);
+
 	struct impl;
 	std::propagate_const<std::unique_ptr<impl>> pImpl;
 };